@@ -1,7 +1,15 @@
 //Standard headers
 #include <limits.h>
+#include <stdio.h>
+#include <string.h>
 #include <string>
+#include <vector>
 #include <fstream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <math.h>
 
 //Raylib headers
@@ -13,34 +21,26 @@
 
 //Project specific algorithm
 #include "dithering.h"
-
-void (*algorithms[])(Image&, bool) = {
-	Dithering::Random,
-	Dithering::Ordered2x2,
-	Dithering::Ordered4x4,
-	Dithering::Ordered8x8,
-	Dithering::Ordered16x16,
-	Dithering::FloydSteinberg};
-
-const char *algorithmNames[] = {
-	"Random",
-	"Ordered 2x2",
-	"Ordered 4x4",
-	"Ordered 8x8",
-	"Ordered 16x16",
-	"Floyd-Steinberg"};
-
-const char *toggleButtonText = "None\nRandom\nOrdered 2x2\nOrdered 4x4\nOrdered 8x8\nOrdered 16x16\nFloyd-Steinberg";
-
-constexpr const int algorithmCount = sizeof(algorithmNames) / sizeof(char *);
+#include "dither.h"
+#include "kernels.h"
+#include "batch.h"
+#include "lruCache.h"
+#include "packedImage.h"
+#include "imageFile.h"
+#include "profiler.h"
+
+//Names of the algorithms and the text of their toggle group, made from the list of the library when the program starts,
+//so the buttons always have the numbers of the batch configurations and the command line
+std::vector<const char *> algorithmNames;
+std::string toggleButtonText;
+int algorithmCount = 0;
 
 const int fontSize = 20;		//Font size for texts
 const int padding = 5;			//Padding of GUI panels
 const float scaleMin = 0.01f;	//Min scale of the image (1%)
 
 Image baseImage; 				//Base image that was loaded
-Image displayedImage; 			//Image that is currently displayed
-Texture2D texture; 				//Texture created form the displayed image
+Texture2D texture; 				//Texture created form the displayed image (owned by the result cache)
 bool imageLoaded = false;   	//Is a image loaded (Should processing be enabled)
 
 bool scaleRender = true; 		//Can the scale of the image be changed
@@ -48,6 +48,65 @@ float scaleAdd = 0.0f; 			//Additional scale from the scrollwheel
 Vector2 moveOffset; 			//Image displaying offset
 
 bool beepOnCompleted = false;	//The program will beep when the operation is finished
+bool progressivePreview = true;	//Point-wise algorithms show the visible part of the image first
+const int previewTileSize = 256;	//Size of the tiles of the progressive preview
+bool showStats = false;			//Shows the time of the stages of the last run (needs DITHER_PROFILE)
+
+//Parameters that give a dithered image, the ones that don't change the result of the algorithm are 0
+struct ResultKey
+{
+	int algorithm;		//-1 is the base image
+	bool colored;
+	bool serpentine;
+	bool linear;
+	unsigned int seed;
+
+	bool operator==(const ResultKey &other) const
+	{
+		return algorithm == other.algorithm && colored == other.colored && serpentine == other.serpentine && linear == other.linear &&
+			   seed == other.seed;
+	}
+};
+
+//Dithered image and its uploaded texture
+//Results with at most 256 colors keep only their packed indices (1 to 8 bits per pixel) and the image is unloaded
+struct Result
+{
+	Image image;
+	Dithering::PackedImage packed;
+	Texture2D texture;
+};
+
+//Recently viewed results, switching back to one of them just shows its texture
+int cacheBudget = 512;			//Memory budget of the cache in MB (images and textures)
+Dithering::LruCache<ResultKey, Result> resultCache((size_t)cacheBudget << 20, [](Result &result)
+{
+	UnloadTexture(result.texture);
+	UnloadImage(result.image);
+});
+
+//Algorithm running in the background, the displayed image stays until it is finished
+struct AlgorithmJob
+{
+	ResultKey key;						//Cache key of the result
+	Image image;						//Copy of the base image that is being processed
+	Dithering::Progress progress;		//Finished rows and cancellation
+	int totalRows;						//Rows the kernels report for the whole job
+	std::atomic<bool> finished{false};	//Set by the worker when the image is ready
+	std::thread worker;
+
+	//Progressive preview, the texture is created from the converted image and then updated tile by tile
+	bool progressive = false;
+	std::atomic<bool> converted{false};	//Set by the worker when the image has its final format
+	std::atomic<bool> previewReady{false};	//Set when the preview texture is created, the worker waits for it before changing pixels
+	Texture2D preview = {};
+	std::mutex tilesMutex;
+	std::vector<Dithering::Tile> finishedTiles;	//Tiles that are dithered but not uploaded yet
+
+	Dithering::PackedImage packed;		//Packed by the worker after dithering, empty when the result has too many colors
+};
+std::unique_ptr<AlgorithmJob> runningJob;
+Result *displayedResult = nullptr;	//Result that is currently displayed (owned by the result cache)
 
 std::string filePath; 			//Input file directory
 std::string applicationPath;	//Path to base folder of the application
@@ -56,32 +115,113 @@ std::string applicationPath;	//Path to base folder of the application
 static const char *filterPaterns[] = {"*.png", "*.bmp", "*.tga", "*.jpg"};
 static constexpr int filterPaternSize = sizeof(filterPaterns) / sizeof(char *);
 static const char *filterDescription = "Image files (*.png, *.bmp, *.tga, *.jpg)";
+static const char *saveFilterPaterns[] = {"*.png", "*.bmp", "*.tga", "*.jpg", "*.pbm", "*.pgm", "*.ppm", "*.raw"};
+static constexpr int saveFilterPaternSize = sizeof(saveFilterPaterns) / sizeof(char *);
+static const char *saveFilterDescription = "Image files (*.png, *.bmp, *.tga, *.jpg, *.pbm, *.pgm, *.ppm, *.raw)";
 
 //------------
 // LOGIC
 //------------
 
+//Stops the running algorithm (if any) and throws away its image
+void CancelAlgorithm()
+{
+	if (!runningJob)
+		return;
+
+	//Kernels check the flag between bands of rows, so this doesn't wait long
+	runningJob->progress.cancelled = true;
+	runningJob->worker.join();
+	if (runningJob->preview.id != 0)
+		UnloadTexture(runningJob->preview);
+	UnloadImage(runningJob->image);
+	runningJob.reset();
+}
+
+//Cache key of an algorithm with the current settings (-1 is the base image)
+ResultKey GetResultKey(int algNumber, bool colored)
+{
+	if (algNumber < 0)
+		return {-1, false, false, false, 0};
+
+	const Dithering::Kernels::Algorithm &algorithm = Dithering::Kernels::GetAlgorithms()[algNumber];
+	const Dithering::Settings &settings = Dithering::GetSettings();
+	//Only random dithering uses the seed and only error diffusion the serpentine scan
+	return {algNumber, colored, !algorithm.pointWise && settings.serpentine, settings.linear,
+			algorithm.kernel == Dithering::Kernels::Random ? settings.seed : 0};
+}
+
+//Displays a cached result, returns false when it isn't in the cache
+bool ShowCachedResult(const ResultKey &key)
+{
+	Result *result = resultCache.Find(key);
+	if (result == nullptr)
+		return false;
+
+	displayedResult = result;
+	texture = result->texture;
+	return true;
+}
+
+//Creates a texture from an image (textures can only be created on the main thread)
+Texture2D UploadTexture(Image image)
+{
+	DITHER_TIME(Dithering::Stage::Upload, (double)image.width * image.height / 1e6);
+	return LoadTextureFromImage(image);
+}
+
+//Adds the image and its texture to the cache and displays them, a packed image replaces the pixels of the image
+void ShowNewResult(const ResultKey &key, Image image, Texture2D imageTexture, Dithering::PackedImage packed = {})
+{
+	//The texture takes the size of the pixels and the image either the same or the size of the packed indices
+	size_t pixelsSize = (size_t)GetPixelDataSize(image.width, image.height, image.format);
+	size_t size = pixelsSize * 2;
+	if (!packed.data.empty())
+	{
+		UnloadImage(image);
+		image = {};
+		size = pixelsSize + packed.data.size();
+	}
+	Result &result = resultCache.Insert(key, {image, std::move(packed), imageTexture}, size);
+	displayedResult = &result;
+	texture = result.texture;
+}
+
+//Shows the base image
+void ShowBaseImage()
+{
+	ResultKey key = GetResultKey(-1, false);
+	if (!ShowCachedResult(key))
+	{
+		Image image = ImageCopy(baseImage);
+		ShowNewResult(key, image, UploadTexture(image));
+	}
+}
+
 //Load a file form the provided path and sets it as the baseImage
 void LoadBaseFile(char* filePath)
 {
+	CancelAlgorithm();
 	if (imageLoaded)
 	{
 		UnloadImage(baseImage);
-		UnloadImage(displayedImage);
-		UnloadTexture(texture);
+		resultCache.Clear();
 		::filePath.clear();
 		imageLoaded = false;
 	}
 
-	// Load the new image
-	baseImage = LoadImage(filePath);
+	// Load the new image, the stats show the loading until an algorithm is started
+	Dithering::Profiler::Reset();
+	{
+		DITHER_TIME(Dithering::Stage::Load, 0.0);
+		baseImage = LoadImage(filePath);
+	}
 	// Don't do anything if the image wasn't loaded
 	if (baseImage.data != nullptr)
 	{
 		//Format the image to the required pixel format
 		//ImageFormat(&baseImage, PIXELFORMAT_UNCOMPRESSED_R8G8B8);
-		displayedImage = ImageCopy(baseImage);
-		texture = LoadTextureFromImage(displayedImage);
+		ShowBaseImage();
 		::filePath = filePath;
 		imageLoaded = true;
 	}
@@ -92,62 +232,276 @@ void LoadBaseFile(char* filePath)
 //Performs batch processing of images
 void DoBatchProcessing(int fileCount, char** paths)
 {
-	int alg = -1, colored = -1;
+	int alg = -1, colored = -1, threads = 0, serpentine = 0, linear = 0;
+	unsigned int seed = 0;
+	std::string paletteText;
+	std::string sizeText;
+	std::string filterText;
+	//Variants of a manifest (several results of every image), the settings of the application are used for them
+	std::vector<Dithering::ManifestVariant> variants;
+	Dithering::ManifestVariant defaults;
+	defaults.suffix = "_processed";
 	//Find a batch configuration file
 	for (int i = 0; i < fileCount; i++)
 	{
 		if(IsFileExtension(paths[i], ".txt"))
 		{
+			if (Dithering::IsBatchManifest(paths[i]))
+			{
+				std::string error;
+				if (!Dithering::LoadBatchManifest(paths[i], defaults, variants, error))
+				{
+					TraceLog(LOG_WARNING, "BATCH: %s: %s", paths[i], error.c_str());
+					return;
+				}
+				break;
+			}
+
 			std::fstream file(paths[i]);
 			if(file.is_open())
 			{
 				//Get the data from the file
 				file >> alg;
 				file >> colored;
+				//Optional thread count (0 or missing uses all cores) and serpentine scan for error diffusion
+				file >> threads;
+				file >> serpentine;
+				//Optional seed for the random dithering
+				file >> seed;
+				//Optional palette (a palette name, median:N, kmeans:N, hex colors or a palette file, - for none)
+				file >> paletteText;
+				//Optional size of the results (WxH, 0 for one side keeps the aspect ratio) and resampling filter (box, bilinear or lanczos)
+				file >> sizeText;
+				file >> filterText;
+				//Optional dithering in linear light
+				file >> linear;
 				file.close();
 				break;
 			}
 		}
 	}
 
-	//If configuration was found do batch processing
+	//A configuration gives one variant
 	if(alg >= 0 && alg < algorithmCount && colored != -1)
 	{
-		Image image;
-		//Dither every image from the passed files
+		Dithering::GetSettings().threadCount = threads;
+		Dithering::GetSettings().serpentine = serpentine == 1;
+		Dithering::GetSettings().linear = linear == 1;
+		Dithering::GetSettings().seed = seed;
+
+		Dithering::BatchVariant &variant = defaults.variant;
+		variant.algorithm = alg;
+		variant.colored = colored == 1;
+		if (!paletteText.empty() && paletteText != "-" && !Dithering::ParsePaletteSpec(paletteText.c_str(), variant.palette))
+		{
+			TraceLog(LOG_WARNING, "BATCH: invalid palette %s", paletteText.c_str());
+			return;
+		}
+		if ((!sizeText.empty() && sscanf(sizeText.c_str(), "%dx%d", &variant.resizeWidth, &variant.resizeHeight) != 2) ||
+			(!filterText.empty() && !Dithering::ParseResampleFilter(filterText.c_str(), variant.filter)))
+		{
+			TraceLog(LOG_WARNING, "BATCH: invalid size %s or filter %s", sizeText.c_str(), filterText.c_str());
+			return;
+		}
+		variants.push_back(defaults);
+	}
+
+	//If configuration was found do batch processing
+	if (!variants.empty())
+	{
+		//Every image from the passed files is exported to the same location with the suffix of every variant (_processed by default)
+		//Dropped directories are frame sequences, their frames are processed in order
+		std::vector<std::string> inputs;
 		for (int i = 0; i < fileCount; i++)
 		{
 			if(IsFileExtension(paths[i], ".txt"))
 				continue;
+			std::vector<std::string> frames = {paths[i]};
+			std::string error;
+			if (DirectoryExists(paths[i]) && !Dithering::GetSequenceFrames(paths[i], frames, error))
+			{
+				TraceLog(LOG_WARNING, "BATCH: %s", error.c_str());
+				continue;
+			}
+			inputs.insert(inputs.end(), frames.begin(), frames.end());
+		}
 
-			image = LoadImage(paths[i]);
-			if (image.data != nullptr)
+		std::vector<Dithering::BatchJob> jobs;
+		for (const std::string &input : inputs)
+		{
+			const char *path = input.c_str();
+			Dithering::BatchJob job = {input, {}};
+			for (const Dithering::ManifestVariant &variant : variants)
 			{
-				algorithms[alg](image, colored);
-				// Export the image to the same location with the _processed suffix
-				ExportImage(image, TextFormat("%s/%s_processed%s", GetDirectoryPath(paths[i]), GetFileNameWithoutExt(paths[i]), GetFileExtension(paths[i])));
-				UnloadImage(image);
+				std::string extension = variant.format.empty() ? GetFileExtension(path) : "." + variant.format;
+				job.outputs.push_back(TextFormat("%s/%s%s%s", GetDirectoryPath(path), GetFileNameWithoutExt(path), variant.suffix.c_str(), extension.c_str()));
 			}
+			jobs.push_back(job);
 		}
+
+		//Images are decoded once, their variants are dithered and encoded at the same time
+		Dithering::BatchOptions options;
+		for (const Dithering::ManifestVariant &variant : variants)
+			options.variants.push_back(variant.variant);
+		options.settings = Dithering::GetSettings();
+		Dithering::BatchStats stats = Dithering::RunBatch(jobs, options, [](const Dithering::BatchFileStatus &file)
+		{
+			if (file.error != nullptr)
+				TraceLog(LOG_WARNING, "BATCH: %s: %s", file.job->outputs[file.variant].c_str(), file.error);
+		});
+		TraceLog(LOG_INFO, "BATCH: %d of %d images processed in %.2f s (%.1f files/s, %.1f MP/s)", stats.files - stats.failed, stats.files,
+				 stats.seconds, stats.FilesPerSecond(), stats.MegapixelsPerSecond());
+	}
+}
+
+//Screen rectangle the image is drawn to
+Rectangle GetImageScreenRect(int width, int height)
+{
+	float screenWidth = GetScreenWidth();
+	float screenHeight = GetScreenHeight();
+	//Calculate the image scale, so it takes as much of the window as possible
+	float scale;
+	if (scaleRender)
+	{
+		scale = fminf(screenWidth / width, screenHeight / height) + scaleAdd;
+		//Clamp the scale
+		scale = fmax(scale, scaleMin);
 	}
+	//Or lock the scale to one if required
+	else
+		scale = 1.0f;
+
+	//Calculate the display size
+	float drawWidth = width * scale;
+	float drawHeight = height * scale;
+	return {(screenWidth - drawWidth) * 0.5f + moveOffset.x, (screenHeight - drawHeight) * 0.5f + moveOffset.y, drawWidth, drawHeight};
 }
 
-//Executes the algorithm from the algorithms array
+//Part of the base image that is visible in the window
+Dithering::Tile GetVisibleTile()
+{
+	Rectangle rect = GetImageScreenRect(baseImage.width, baseImage.height);
+	float scale = rect.width / baseImage.width;
+	int left = (int)fmaxf(0.0f, -rect.x / scale);
+	int top = (int)fmaxf(0.0f, -rect.y / scale);
+	int right = (int)fminf((float)baseImage.width, (GetScreenWidth() - rect.x) / scale + 1.0f);
+	int bottom = (int)fminf((float)baseImage.height, (GetScreenHeight() - rect.y) / scale + 1.0f);
+	return {left, top, right > left ? right - left : 0, bottom > top ? bottom - top : 0};
+}
+
+//Starts the algorithm on a copy of the base image in the background, a running algorithm is cancelled
+//Results that are in the cache are shown right away
 void ExecuteAlgorithm(int algNumber, bool colored)
 {
 	if(algNumber < 0 || algNumber >= algorithmCount)
 		return;
 
-	//Unload old data
-	UnloadTexture(texture);
-	UnloadImage(displayedImage);
-	displayedImage = ImageCopy(baseImage);
+	CancelAlgorithm();
+
+	ResultKey key = GetResultKey(algNumber, colored);
+	if (ShowCachedResult(key))
+		return;
+
+	//The stats show this run (and the export of its result)
+	Dithering::Profiler::Reset();
+	runningJob = std::make_unique<AlgorithmJob>();
+	runningJob->key = key;
+	runningJob->image = ImageCopy(baseImage);
+	runningJob->totalRows = baseImage.height;
+
+	//The worker gets its own copy of the settings, so the options can be changed while it runs
+	Dithering::Settings settings = Dithering::GetSettings();
+	settings.progress = &runningJob->progress;
+	AlgorithmJob *job = runningJob.get();
+
+	//Point-wise algorithms can dither the visible tiles first, every column of tiles reports all rows of the image
+	if (progressivePreview && Dithering::Kernels::GetAlgorithms()[algNumber].pointWise)
+	{
+		std::vector<Dithering::Tile> tiles = Dithering::GetTiles(baseImage.width, baseImage.height, previewTileSize, GetVisibleTile());
+		job->progressive = true;
+		job->totalRows = baseImage.height * ((baseImage.width + previewTileSize - 1) / previewTileSize);
+		job->worker = std::thread([job, algNumber, colored, settings, tiles]
+		{
+			//The worker only reads its copy of the settings, the options can change while it runs
+			Dithering::PixelBuffer buffer = Dithering::GetPixelBuffer(job->image, colored, settings.linear);
+			job->converted = true;
+			while (!job->previewReady && !job->progress.cancelled)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			Dithering::DitherTiles(buffer, algNumber, tiles, settings, [job](const Dithering::Tile &tile)
+			{
+				std::lock_guard<std::mutex> lock(job->tilesMutex);
+				job->finishedTiles.push_back(tile);
+			});
+			if (!job->progress.cancelled)
+				Dithering::PackImage(buffer, job->packed, settings.threadCount);
+			job->finished = true;
+		});
+		return;
+	}
+
+	job->worker = std::thread([job, algNumber, colored, settings]
+	{
+		Dithering::Dither(job->image, algNumber, colored, settings);
+		if (!job->progress.cancelled)
+			Dithering::PackImage(Dithering::GetPixelBuffer(job->image, true), job->packed, settings.threadCount);
+		job->finished = true;
+	});
+}
+
+//Copies the finished tiles of the progressive preview to its texture
+void UploadFinishedTiles(AlgorithmJob &job)
+{
+	std::vector<Dithering::Tile> tiles;
+	{
+		std::lock_guard<std::mutex> lock(job.tilesMutex);
+		tiles.swap(job.finishedTiles);
+	}
 
-	//Execute the algorithm
-	algorithms[algNumber](displayedImage, colored);
+	//The worker doesn't touch finished tiles anymore, their rows are packed because the texture update takes only whole rows
+	int bytesPerPixel = GetPixelDataSize(1, 1, job.image.format);
+	std::vector<unsigned char> pixels;
+	for (const Dithering::Tile &tile : tiles)
+	{
+		DITHER_TIME(Dithering::Stage::Upload, (double)tile.width * tile.height / 1e6);
+		pixels.resize((size_t)tile.width * tile.height * bytesPerPixel);
+		for (int y = 0; y < tile.height; y++)
+		{
+			const unsigned char *row = (const unsigned char *)job.image.data + ((size_t)(tile.y + y) * job.image.width + tile.x) * bytesPerPixel;
+			memcpy(pixels.data() + (size_t)y * tile.width * bytesPerPixel, row, (size_t)tile.width * bytesPerPixel);
+		}
+		UpdateTextureRec(job.preview, {(float)tile.x, (float)tile.y, (float)tile.width, (float)tile.height}, pixels.data());
+	}
+}
 
-	//Load the resoult to the display texture
-	texture = LoadTextureFromImage(displayedImage);
+//Shows the result of the background algorithm when it is finished
+void UpdateAlgorithm()
+{
+	if (!runningJob)
+		return;
+
+	//The preview starts as the converted image and gets the dithered tiles as they are finished
+	if (runningJob->progressive && runningJob->converted)
+	{
+		if (!runningJob->previewReady)
+		{
+			runningJob->preview = UploadTexture(runningJob->image);
+			runningJob->previewReady = true;
+		}
+		UploadFinishedTiles(*runningJob);
+	}
+
+	if (!runningJob->finished)
+		return;
+
+	runningJob->worker.join();
+
+	//Load the resoult to the display texture (textures can only be created on the main thread), the preview already has it
+	if (runningJob->progressive)
+		ShowNewResult(runningJob->key, runningJob->image, runningJob->preview, std::move(runningJob->packed));
+	else
+		ShowNewResult(runningJob->key, runningJob->image, UploadTexture(runningJob->image), std::move(runningJob->packed));
+	runningJob.reset();
 
 	if (beepOnCompleted)
 		tinyfd_beep();
@@ -175,6 +529,7 @@ void HandleFileDropping()
 void UpdateLoop()
 {
 	HandleFileDropping();
+	UpdateAlgorithm();
 
 	if (imageLoaded)
 	{
@@ -189,6 +544,32 @@ void UpdateLoop()
 	}
 }
 
+//Saves a result, packed results are written with their indices when the format allows it (png, pbm, pgm, ppm and raw)
+bool ExportResult(const Result &result, const char *path)
+{
+	if (result.packed.data.empty())
+	{
+		DITHER_TIME(Dithering::Stage::Save, (double)result.image.width * result.image.height / 1e6);
+		return ExportImage(result.image, path);
+	}
+	if (Dithering::IsSupportedOutput(path) && !IsFileExtension(path, ".bmp;.tga;.jpg;.jpeg"))
+		return Dithering::SavePackedImageFile(path, result.packed);
+
+	//Other formats get the unpacked pixels
+	const Dithering::PackedImage &packed = result.packed;
+	Image image = GenImageColor(packed.width, packed.height, BLACK);
+	ImageFormat(&image, packed.gray ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE : PIXELFORMAT_UNCOMPRESSED_R8G8B8);
+	Dithering::PixelBuffer buffer = Dithering::GetPixelBuffer(image, true);
+	Dithering::UnpackImage(packed, buffer, Dithering::GetSettings().threadCount);
+	bool exported;
+	{
+		DITHER_TIME(Dithering::Stage::Save, (double)packed.width * packed.height / 1e6);
+		exported = ExportImage(image, path);
+	}
+	UnloadImage(image);
+	return exported;
+}
+
 //Native dialogs for exporting the algorithm resoult
 void SaveDialog()
 {
@@ -196,10 +577,10 @@ void SaveDialog()
 	startPath += "/out";
 	startPath += GetFileExtension(filePath.c_str());
 
-	char* savePath = tinyfd_saveFileDialog("Export the file...", startPath.c_str(), filterPaternSize, filterPaterns, filterDescription);
+	char* savePath = tinyfd_saveFileDialog("Export the file...", startPath.c_str(), saveFilterPaternSize, saveFilterPaterns, saveFilterDescription);
 	if(savePath != nullptr)
 	{
-		if(ExportImage(displayedImage, savePath))
+		if(ExportResult(*displayedResult, savePath))
 			tinyfd_messageBox("Export status", "File exported", "ok", "info", 1);
 		else
 			tinyfd_messageBox("Export status", "File export error", "ok", "error", 1);
@@ -239,6 +620,10 @@ void DrawGUI()
 	static bool processColored;
 	static bool showAlgorithmSelection;
 	static bool showOptions;
+	static bool editThreads;
+	static bool editSeed;
+	static bool editCacheBudget;
+	static int seed;
 
 	// Start cooridnates of the GUI
 	const float startX = 20;
@@ -246,7 +631,7 @@ void DrawGUI()
 
 	// Button dimensions
 	const float buttonHeight = fontSize + padding * 2;
-	const float buttonWidth = GetMaxTextSize(algorithmNames, algorithmCount) + padding * 8;
+	const float buttonWidth = GetMaxTextSize(algorithmNames.data(), algorithmCount) + padding * 8;
 
 	Rectangle drawRect = {startX, startY, buttonWidth, buttonHeight};
 
@@ -268,7 +653,7 @@ void DrawGUI()
 		drawRect.y += buttonHeight + padding;
 		int initialSelected = selectedAlgorithm;
 		if(showAlgorithmSelection)
-			selectedAlgorithm = GuiToggleGroup(drawRect, toggleButtonText, selectedAlgorithm);
+			selectedAlgorithm = GuiToggleGroup(drawRect, toggleButtonText.c_str(), selectedAlgorithm);
 		drawRect.x += buttonWidth + padding;
 		drawRect.y = startY;
 
@@ -276,6 +661,11 @@ void DrawGUI()
 		showOptions = GuiToggle(drawRect, TextFormat("%s options", showOptions ? "Hide" : "Show"), showOptions);
 		drawRect.y += buttonHeight + padding;
 		bool initialColored = processColored;
+		bool &serpentine = Dithering::GetSettings().serpentine;
+		bool initialSerpentine = serpentine;
+		bool &linear = Dithering::GetSettings().linear;
+		bool initialLinear = linear;
+		int initialSeed = seed;
 		if(showOptions)
 		{
 			processColored = GuiToggle(drawRect, "Colored", processColored);
@@ -296,23 +686,109 @@ void DrawGUI()
 
 			beepOnCompleted = GuiToggle(drawRect, TextFormat("Beep [%c]", beepOnCompleted ? 'X' : ' '), beepOnCompleted);
 			drawRect.y += buttonHeight + padding;
+
+			// Draw progressive preview controll (visible part first for random and ordered dithering)
+			progressivePreview = GuiToggle(drawRect, TextFormat("Progressive [%c]", progressivePreview ? 'X' : ' '), progressivePreview);
+			drawRect.y += buttonHeight + padding;
+
+			// Draw thread count controll (0 uses all cores)
+			if (GuiSpinner(drawRect, "Threads", &Dithering::GetSettings().threadCount, 0, 256, editThreads))
+				editThreads = !editThreads;
+			drawRect.y += buttonHeight + padding;
+
+			// Draw parallel error diffusion controll (same result, so nothing has to be recomputed)
+			bool &wavefront = Dithering::GetSettings().wavefront;
+			wavefront = GuiToggle(drawRect, TextFormat("Parallel diffusion [%c]", wavefront ? 'X' : ' '), wavefront);
+			drawRect.y += buttonHeight + padding;
+
+			// Draw serpentine scan controll for error diffusion
+			serpentine = GuiToggle(drawRect, TextFormat("Serpentine [%c]", serpentine ? 'X' : ' '), serpentine);
+			drawRect.y += buttonHeight + padding;
+
+			// Draw linear light controll (gamma correct dithering)
+			linear = GuiToggle(drawRect, TextFormat("Linear light [%c]", linear ? 'X' : ' '), linear);
+			drawRect.y += buttonHeight + padding;
+
+			// Draw random seed controll
+			if (GuiValueBox(drawRect, "Seed", &seed, 0, INT_MAX, editSeed))
+				editSeed = !editSeed;
+			drawRect.y += buttonHeight + padding;
+
+			// Draw the memory budget of the result cache (in MB)
+			int initialCacheBudget = cacheBudget;
+			if (GuiSpinner(drawRect, "Cache MB", &cacheBudget, 0, 65536, editCacheBudget))
+				editCacheBudget = !editCacheBudget;
+			if (cacheBudget != initialCacheBudget)
+				resultCache.SetBudget((size_t)cacheBudget << 20);
+			drawRect.y += buttonHeight + padding;
+
+			// Draw the stats overlay controll (only when the timers are compiled in)
+			if (Dithering::Profiler::IsEnabled())
+			{
+				showStats = GuiToggle(drawRect, TextFormat("Stats [%c]", showStats ? 'X' : ' '), showStats);
+				drawRect.y += buttonHeight + padding;
+			}
 		}
 
 		// Process the image if paramers were changed
-		if (initialSelected != selectedAlgorithm || initialColored != processColored)
+		if (initialSelected != selectedAlgorithm || initialColored != processColored || initialSerpentine != serpentine || initialLinear != linear ||
+			initialSeed != seed)
 		{
+			Dithering::GetSettings().seed = seed;
+
 			// If 0 is seleted then reload the base image
 			if (selectedAlgorithm == 0)
 			{
-				UnloadTexture(texture);
-				UnloadImage(displayedImage);
-				displayedImage = ImageCopy(baseImage);
-				texture = LoadTextureFromImage(displayedImage);
+				CancelAlgorithm();
+				ShowBaseImage();
 			}
 			else
 				ExecuteAlgorithm(selectedAlgorithm - 1, processColored);
 		}
+
+		// Draw the progress of the running algorithm at the bottom of the window
+		if (runningJob)
+		{
+			// The percentage is drawn right of the bar
+			float textWidth = MeasureText("100%", fontSize) + padding;
+			Rectangle progressRect = {startX, GetScreenHeight() - startY - buttonHeight, GetScreenWidth() - startX * 2 - textWidth, buttonHeight};
+			float done = (float)runningJob->progress.rows / runningJob->totalRows;
+			GuiProgressBar(progressRect, nullptr, TextFormat("%d%%", (int)(done * 100.0f)), done, 0.0f, 1.0f);
+		}
+	}
+}
+
+//Draws the time of every stage of the last run at the top right corner of the window
+void DrawStats()
+{
+	Dithering::ProfileStats stats = Dithering::Profiler::GetStats();
+	std::vector<std::string> lines;
+	for (int i = 0; i < (int)Dithering::Stage::Count; i++)
+	{
+		const Dithering::StageStats &stage = stats.stages[i];
+		if (stage.count == 0)
+			continue;
+		//Loading doesn't know the size of the image before it is finished, so it has no MP/s
+		const char *name = Dithering::GetStageName((Dithering::Stage)i);
+		if (stage.megapixels > 0.0)
+			lines.push_back(TextFormat("%s: %.1f ms (%.1f MP/s)", name, stage.seconds * 1000.0, stage.MegapixelsPerSecond()));
+		else
+			lines.push_back(TextFormat("%s: %.1f ms", name, stage.seconds * 1000.0));
 	}
+	if (lines.empty())
+		return;
+
+	int width = 0;
+	for (const std::string &line : lines)
+	{
+		int lineWidth = MeasureText(line.c_str(), fontSize);
+		width = lineWidth > width ? lineWidth : width;
+	}
+	const int lineHeight = fontSize + padding;
+	int x = GetScreenWidth() - width - padding * 2 - 20;
+	DrawRectangle(x, 20, width + padding * 2, (int)lines.size() * lineHeight + padding, Fade(LIGHTGRAY, 0.8f));
+	for (int i = 0; i < (int)lines.size(); i++)
+		DrawText(lines[i].c_str(), x + padding, 20 + padding + i * lineHeight, fontSize, BLACK);
 }
 
 //Main application draw loop
@@ -322,26 +798,12 @@ void DrawLoop()
 	ClearBackground(WHITE);
 	if (imageLoaded)
 	{
-		float screenWidth = GetScreenWidth();
-		float screenHeight = GetScreenHeight();
-		//Calculate the image scale, so it takes as much of the window as possible
-		float scale;
-		if (scaleRender)
-		{
-			scale = fminf(screenWidth / texture.width, screenHeight / texture.height) + scaleAdd;
-			//Clamp the scale
-			scale = fmax(scale, scaleMin);
-		}
-		//Or lock the scale to one if required
-		else
-			scale = 1.0f;
-
-		//Calculate the display size
-		float drawWidth = texture.width * scale;
-		float drawHeight = texture.height * scale;
+		//A progressive preview is shown instead of the last result
+		Texture2D drawTexture = runningJob && runningJob->previewReady ? runningJob->preview : texture;
 
 		//Draw the image with the proper scale and offset
-		DrawTextureEx(texture, (Vector2){(screenWidth - drawWidth) * 0.5f + moveOffset.x, (screenHeight - drawHeight) * 0.5f + moveOffset.y}, 0.0f, scale, WHITE);
+		Rectangle rect = GetImageScreenRect(drawTexture.width, drawTexture.height);
+		DrawTextureEx(drawTexture, (Vector2){rect.x, rect.y}, 0.0f, rect.width / drawTexture.width, WHITE);
 	}
 	else
 	{
@@ -351,12 +813,30 @@ void DrawLoop()
 		DrawText(text, ((float)GetScreenWidth() - xSize) * 0.5f, ((float)GetScreenHeight() - fontSize) * 0.5f, fontSize, BLACK);
 	}
 	DrawGUI();
+	if (showStats)
+		DrawStats();
 	EndDrawing();
 }
 
+//Fills the names of the algorithms and the text of the toggle group ("None" is the base image)
+void LoadAlgorithmNames()
+{
+	const Dithering::Kernels::Algorithm *algorithms = Dithering::Kernels::GetAlgorithms();
+	algorithmCount = Dithering::Kernels::GetAlgorithmCount();
+	toggleButtonText = "None";
+	for (int i = 0; i < algorithmCount; i++)
+	{
+		algorithmNames.push_back(algorithms[i].name);
+		toggleButtonText += "\n";
+		toggleButtonText += algorithms[i].name;
+	}
+}
+
 //Entry point
 int main(int argc, char **argv)
 {
+	LoadAlgorithmNames();
+
 	//Bach processing can start only when the program has more than 2 arguments (.exe file path, one batch file, one image)
 	if(argc > 2)
 	{
@@ -395,11 +875,12 @@ int main(int argc, char **argv)
 	}
 	
 	//Clean up if image was loaded
+	CancelAlgorithm();
 	if(imageLoaded)
 	{
 		UnloadImage(baseImage);
-		UnloadImage(displayedImage);
-		UnloadTexture(texture);
+		//Textures have to be unloaded before the window is closed
+		resultCache.Clear();
 	}
 	CloseWindow();
 }
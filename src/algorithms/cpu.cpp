@@ -0,0 +1,70 @@
+#include "cpu.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define DITHER_X86
+#endif
+
+namespace Dithering
+{
+	//Checks which instruction sets are supported by the CPU and the OS
+	static Isa DetectIsa()
+	{
+#ifdef DITHER_X86
+		unsigned int eax, ebx, ecx, edx;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(edx & bit_SSE2))
+			return Isa::Scalar;
+
+		//AVX2 also needs the OS to save the ymm registers (OSXSAVE and XCR0 bits 1 and 2)
+		if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX))
+		{
+			unsigned int xcrLow, xcrHigh;
+			__asm__("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+			if ((xcrLow & 6) == 6 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2))
+				return Isa::AVX2;
+		}
+		return Isa::SSE2;
+#else
+		return Isa::Scalar;
+#endif
+	}
+
+	//Detected instruction set lowered to the one requested in DITHER_ISA
+	static Isa SelectIsa()
+	{
+		Isa isa = DetectIsa();
+		const char *requested = getenv("DITHER_ISA");
+		if (requested == nullptr)
+			return isa;
+
+		for (int i = (int)Isa::Scalar; i < (int)isa; i++)
+		{
+			Isa candidate = (Isa)i;
+			if (strcmp(requested, GetIsaName(candidate)) == 0)
+				return candidate;
+		}
+		return isa;
+	}
+
+	Isa GetIsa()
+	{
+		static const Isa isa = SelectIsa();
+		return isa;
+	}
+
+	const char *GetIsaName(Isa isa)
+	{
+		switch (isa)
+		{
+			case Isa::SSE2:
+				return "sse2";
+			case Isa::AVX2:
+				return "avx2";
+			default:
+				return "scalar";
+		}
+	}
+}
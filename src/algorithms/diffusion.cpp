@@ -0,0 +1,436 @@
+#include "kernels.h"
+#include "linearLight.h"
+#include "threadPool.h"
+#include "palette.h"
+#include "profiler.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Dithering
+{
+	namespace Kernels
+	{
+		//Error diffusion kernels, row 0 is the current row (only pixels after x can get error there)
+		//Columns go from x - left to x + right, the weights are divided by divisor
+		struct FloydSteinbergWeights
+		{
+			static constexpr int rows = 2, left = 1, right = 1, divisor = 16;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 7},
+																	{3, 5, 1}};
+		};
+
+		struct JarvisJudiceNinkeWeights
+		{
+			static constexpr int rows = 3, left = 2, right = 2, divisor = 48;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 0, 7, 5},
+																	{3, 5, 7, 5, 3},
+																	{1, 3, 5, 3, 1}};
+		};
+
+		struct StuckiWeights
+		{
+			static constexpr int rows = 3, left = 2, right = 2, divisor = 42;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 0, 8, 4},
+																	{2, 4, 8, 4, 2},
+																	{1, 2, 4, 2, 1}};
+		};
+
+		struct BurkesWeights
+		{
+			static constexpr int rows = 2, left = 2, right = 2, divisor = 32;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 0, 8, 4},
+																	{2, 4, 8, 4, 2}};
+		};
+
+		struct SierraWeights
+		{
+			static constexpr int rows = 3, left = 2, right = 2, divisor = 32;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 0, 5, 3},
+																	{2, 4, 5, 4, 2},
+																	{0, 2, 3, 2, 0}};
+		};
+
+		struct TwoRowSierraWeights
+		{
+			static constexpr int rows = 2, left = 2, right = 2, divisor = 16;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 0, 4, 3},
+																	{1, 2, 3, 2, 1}};
+		};
+
+		struct SierraLiteWeights
+		{
+			static constexpr int rows = 2, left = 1, right = 1, divisor = 4;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 2},
+																	{1, 1, 0}};
+		};
+
+		//Atkinson only passes on 6/8 of the error
+		struct AtkinsonWeights
+		{
+			static constexpr int rows = 3, left = 1, right = 2, divisor = 8;
+			static constexpr int weights[rows][left + 1 + right] = {{0, 0, 1, 1},
+																	{1, 1, 1, 0},
+																	{0, 1, 0, 0}};
+		};
+
+		//Divides the weighted error sum by the divisor rounding to the nearest integer (a shift for powers of two)
+		template<int Divisor>
+		static inline int ScaleError(int sum)
+		{
+			int n = sum + Divisor / 2;
+			if constexpr ((Divisor & (Divisor - 1)) == 0)
+				return n >> __builtin_ctz(Divisor);
+			else
+				return n >= 0 ? n / Divisor : -((-n + Divisor - 1) / Divisor);
+		}
+
+		//How often (in pixels) a row publishes its progress to the row below
+		constexpr int progressStep = 64;
+
+		//Error diffusion that keeps only a ring of error rows instead of a copy of the whole image
+		//Errors are integers, every row stores the sum of weight * error for its pixels and the sum is divided when the pixel is reached
+		//Linear diffusion decodes the pixels to 12 bits of linear light through a table, its sums need 32 bits
+		template<Format F, typename Weights, bool Linear>
+		class ErrorDiffusion
+		{
+		public:
+			using Traits = FormatTraits<F>;
+			using Error = std::conditional_t<Linear, int32_t, int16_t>;
+			static constexpr int white = Linear ? linearWhite : 255;
+			static constexpr int C = Traits::colorChannels;
+			static constexpr int columns = Weights::left + 1 + Weights::right;
+			//Pixels a row has to stay ahead of the row below it, so the rows never write to the same error at the same time
+			static constexpr int lag = Weights::left + Weights::right + 1;
+			//Padding on both sides of an error row, right to left rows mirror the kernel
+			static constexpr int padding = Weights::left > Weights::right ? Weights::left : Weights::right;
+
+			//ringRows has to be at least Weights::rows, rows that run at the same time need threads - 1 more
+			//With a palette every pixel gets the nearest palette color, otherwise every chanel is set to 0 or 255
+			//Pixels kept by temporal get their previous value instead
+			ErrorDiffusion(int width, int ringRows, const Palette *palette, const TemporalFrame *temporal)
+				: width(width), ringRows(ringRows), rowLength((width + padding * 2) * C),
+				  errors((size_t)rowLength * ringRows, 0), palette(palette), temporal(temporal)
+			{
+			}
+
+			//Dithers row y of the buffer, from right to left when Reverse is set (serpentine scan)
+			//The error rows belong to the row of the image (buffer.y + y), so one ErrorDiffusion can dither an image in strips of rows
+			//When above is set the row waits for the row above to be lag pixels ahead before touching a pixel
+			template<bool Reverse>
+			void DitherRow(PixelBuffer &buffer, int y, const std::atomic<int> *above, std::atomic<int> *progress)
+			{
+				if (palette != nullptr)
+					DitherRow<Reverse, true>(buffer, y, above, progress);
+				else
+					DitherRow<Reverse, false>(buffer, y, above, progress);
+			}
+
+		private:
+			template<bool Reverse, bool Paletted>
+			void DitherRow(PixelBuffer &buffer, int y, const std::atomic<int> *above, std::atomic<int> *progress)
+			{
+				constexpr int direction = Reverse ? -1 : 1;
+
+				//The last row this one writes to was last used by a row that is already finished
+				int imageRow = buffer.y + y;
+				memset(ErrorRow(imageRow + Weights::rows - 1) - padding * C, 0, rowLength * sizeof(Error));
+
+				//Rows below the image still have ring rows, nothing reads the errors written to them
+				Error *errorRows[Weights::rows];
+				const LinearTables &tables = GetLinearTables();
+				for (int r = 0; r < Weights::rows; r++)
+					errorRows[r] = ErrorRow(imageRow + r);
+
+				byte *row = buffer.data + (long long)y * buffer.stride;
+				const byte *keep = temporal != nullptr ? temporal->keep + (size_t)imageRow * width : nullptr;
+				const byte *previousRow = temporal != nullptr ? temporal->previous + (size_t)imageRow * width * Traits::bytesPerPixel : nullptr;
+				int available = 0;
+				for (int step = 0; step < width; step++)
+				{
+					int x = Reverse ? width - 1 - step : step;
+					byte *pixel = row + x * Traits::bytesPerPixel;
+
+					if (above != nullptr)
+					{
+						int needed = step + lag < width ? step + lag : width;
+						while (available < needed)
+						{
+							available = above->load(std::memory_order_acquire);
+							if (available < needed)
+								std::this_thread::yield();
+						}
+					}
+
+					//A kept pixel is quantized to its previous value, its error is diffused like the error of any other pixel
+					const byte *kept = keep != nullptr && keep[x] != 0 ? previousRow + x * Traits::bytesPerPixel : nullptr;
+
+					//The whole pixel is needed to pick a palette color, the values are clamped so the errors stay small with any palette
+					//Colors are picked by the encoded values, in linear light the errors are differences of linear light
+					int paletteValues[C];
+					if constexpr (Paletted)
+					{
+						int encoded[C];
+						for (int c = 0; c < C; c++)
+						{
+							int value = Decode(tables, pixel[c]) + ScaleError<Weights::divisor>(errorRows[0][x * C + c]);
+							paletteValues[c] = value < 0 ? 0 : value > white ? white : value;
+							encoded[c] = Linear ? tables.toSrgb[paletteValues[c]] : paletteValues[c];
+						}
+						if (kept != nullptr)
+						{
+							for (int c = 0; c < C; c++)
+								pixel[c] = kept[c];
+						}
+						else if constexpr (C == 1)
+							pixel[0] = palette->NearestGray(encoded[0]);
+						else
+						{
+							const Color &color = palette->GetColors()[palette->Nearest(encoded[0], encoded[1], encoded[2])];
+							pixel[0] = color.r;
+							pixel[1] = color.g;
+							pixel[2] = color.b;
+						}
+					}
+
+					for (int c = 0; c < C; c++)
+					{
+						int index = x * C + c;
+						int error;
+						if constexpr (Paletted)
+							error = paletteValues[c] - Decode(tables, pixel[c]);
+						else
+						{
+							int value = Decode(tables, pixel[c]) + ScaleError<Weights::divisor>(errorRows[0][index]);
+							int newValue = (kept != nullptr ? kept[c] > 127 : value > white / 2) ? white : 0;
+							pixel[c] = newValue != 0 ? 255 : 0;
+							error = value - newValue;
+						}
+
+						//Weights are constants, so the compiler unrolls this and drops the zero ones
+						for (int r = 0; r < Weights::rows; r++)
+						{
+							for (int i = 0; i < columns; i++)
+							{
+								if (Weights::weights[r][i] != 0)
+									errorRows[r][index + (i - Weights::left) * direction * C] += (Error)(Weights::weights[r][i] * error);
+							}
+						}
+					}
+
+					if (progress != nullptr && (step + 1) % progressStep == 0)
+						progress->store(step + 1, std::memory_order_release);
+				}
+				if (progress != nullptr)
+					progress->store(width, std::memory_order_release);
+			}
+
+			//Value of a chanel in the units of the errors
+			static int Decode(const LinearTables &tables, byte value)
+			{
+				if constexpr (Linear)
+					return tables.toLinear[value];
+				else
+					return value;
+			}
+
+			//Errors for the first pixel of a row, the padding on both sides takes the errors that fall outside the image
+			Error *ErrorRow(int y)
+			{
+				return errors.data() + (size_t)(y % ringRows) * rowLength + padding * C;
+			}
+
+			int width;
+			int ringRows;
+			int rowLength;
+			std::vector<Error> errors;
+			const Palette *palette;
+			const TemporalFrame *temporal;
+		};
+
+		//Threads that dither rows at the same time, the ring of error rows needs one row for each of them
+		static int GetDiffusionThreads(const Settings &settings, int height)
+		{
+			int threads = GetThreadCount(settings.threadCount);
+			return threads < height ? threads : height;
+		}
+
+		//Dithers all rows of the buffer with the error rows of diffusion, on at most threads threads
+		template<typename Diffusion>
+		static void DiffuseRows(Diffusion &diffusion, PixelBuffer &buffer, const Settings &settings, int threads)
+		{
+			const int height = buffer.height;
+			threads = threads < height ? threads : height;
+
+			//Serpentine rows run in opposite directions, so they can't be pipelined
+			if (!settings.wavefront || settings.serpentine || threads < 2)
+			{
+				for (int y = 0; y < height && !IsCancelled(settings); y++)
+				{
+					LoadSourceRow(buffer, y, settings);
+					if (settings.serpentine && (buffer.y + y) % 2 == 1)
+						diffusion.template DitherRow<true>(buffer, y, nullptr, nullptr);
+					else
+						diffusion.template DitherRow<false>(buffer, y, nullptr, nullptr);
+					AddProgress(settings, 1);
+				}
+				return;
+			}
+
+			//Rows are taken in order, so every row waits only for a row that is already being processed
+			//A cancelled kernel stops taking rows, the rows that were taken are finished so no row waits forever
+			std::unique_ptr<std::atomic<int>[]> progress(new std::atomic<int>[height]);
+			for (int y = 0; y < height; y++)
+				progress[y].store(0, std::memory_order_relaxed);
+			std::atomic<int> nextRow{0};
+
+			GetThreadPool(threads)->ParallelFor(threads, 1, threads, [&](int, int)
+			{
+				DITHER_TRACE("Wavefront");
+				while (!IsCancelled(settings))
+				{
+					int y = nextRow.fetch_add(1);
+					if (y >= height)
+						break;
+					//Only this row touches its pixels, so it is converted before waiting for the row above
+					LoadSourceRow(buffer, y, settings);
+					diffusion.template DitherRow<false>(buffer, y, y > 0 ? &progress[y - 1] : nullptr, &progress[y]);
+					AddProgress(settings, 1);
+				}
+			});
+		}
+
+		template<typename Weights>
+		struct DiffusionKernel
+		{
+			template<Format F>
+			struct Kernel
+			{
+				static void Run(PixelBuffer &buffer, const Settings &settings)
+				{
+					if (settings.linear)
+						Run<true>(buffer, settings);
+					else
+						Run<false>(buffer, settings);
+				}
+
+				template<bool Linear>
+				static void Run(PixelBuffer &buffer, const Settings &settings)
+				{
+					int threads = GetDiffusionThreads(settings, buffer.height);
+					ErrorDiffusion<F, Weights, Linear> diffusion(buffer.width, threads + Weights::rows - 1, settings.palette, settings.temporal);
+					DiffuseRows(diffusion, buffer, settings, threads);
+				}
+			};
+
+			//Keeps the error rows of an image between its strips
+			template<Format F, bool Linear>
+			class Stream : public DiffusionStream
+			{
+			public:
+				Stream(int width, const Settings &settings)
+					: threads(GetThreadCount(settings.threadCount)), diffusion(width, threads + Weights::rows - 1, settings.palette, settings.temporal)
+				{
+				}
+
+				void Run(PixelBuffer &strip, const Settings &settings) override
+				{
+					DiffuseRows(diffusion, strip, settings, threads);
+				}
+
+			private:
+				int threads;
+				ErrorDiffusion<F, Weights, Linear> diffusion;
+			};
+
+			template<bool Linear>
+			static std::unique_ptr<DiffusionStream> CreateStream(int width, Format format, const Settings &settings)
+			{
+				switch (format)
+				{
+					case Format::Grayscale:
+						return std::make_unique<Stream<Format::Grayscale, Linear>>(width, settings);
+					case Format::R8G8B8:
+						return std::make_unique<Stream<Format::R8G8B8, Linear>>(width, settings);
+					default:
+						return std::make_unique<Stream<Format::R8G8B8A8, Linear>>(width, settings);
+				}
+			}
+
+			//The strips of an image are all dithered with the settings of the stream
+			static std::unique_ptr<DiffusionStream> CreateStream(int width, Format format, const Settings &settings)
+			{
+				return settings.linear ? CreateStream<true>(width, format, settings) : CreateStream<false>(width, format, settings);
+			}
+		};
+
+		void FloydSteinberg(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<FloydSteinbergWeights>::Kernel>(buffer, settings);
+		}
+
+		void JarvisJudiceNinke(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<JarvisJudiceNinkeWeights>::Kernel>(buffer, settings);
+		}
+
+		void Stucki(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<StuckiWeights>::Kernel>(buffer, settings);
+		}
+
+		void Burkes(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<BurkesWeights>::Kernel>(buffer, settings);
+		}
+
+		void Sierra(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<SierraWeights>::Kernel>(buffer, settings);
+		}
+
+		void TwoRowSierra(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<TwoRowSierraWeights>::Kernel>(buffer, settings);
+		}
+
+		void SierraLite(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<SierraLiteWeights>::Kernel>(buffer, settings);
+		}
+
+		void Atkinson(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<DiffusionKernel<AtkinsonWeights>::Kernel>(buffer, settings);
+		}
+
+		std::unique_ptr<DiffusionStream> CreateDiffusionStream(const Algorithm &algorithm, int width, Format format, const Settings &settings)
+		{
+			using Create = std::unique_ptr<DiffusionStream> (*)(int, Format, const Settings &);
+			static const struct
+			{
+				void (*kernel)(PixelBuffer &, const Settings &);
+				Create create;
+			} streams[] = {{FloydSteinberg, DiffusionKernel<FloydSteinbergWeights>::CreateStream},
+						   {JarvisJudiceNinke, DiffusionKernel<JarvisJudiceNinkeWeights>::CreateStream},
+						   {Stucki, DiffusionKernel<StuckiWeights>::CreateStream},
+						   {Burkes, DiffusionKernel<BurkesWeights>::CreateStream},
+						   {Sierra, DiffusionKernel<SierraWeights>::CreateStream},
+						   {TwoRowSierra, DiffusionKernel<TwoRowSierraWeights>::CreateStream},
+						   {SierraLite, DiffusionKernel<SierraLiteWeights>::CreateStream},
+						   {Atkinson, DiffusionKernel<AtkinsonWeights>::CreateStream}};
+
+			for (const auto &stream : streams)
+			{
+				if (stream.kernel == algorithm.kernel)
+					return stream.create(width, format, settings);
+			}
+			return nullptr;
+		}
+	}
+}
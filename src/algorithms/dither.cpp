@@ -0,0 +1,255 @@
+#include "dither.h"
+#include "linearLight.h"
+#include "profiler.h"
+#include "threadPool.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace Dithering
+{
+	int FindAlgorithm(const char *name)
+	{
+		const Kernels::Algorithm *algorithms = Kernels::GetAlgorithms();
+		int count = Kernels::GetAlgorithmCount();
+
+		//Algorithms can be selected by the index used in the batch configuration
+		char *end;
+		long index = strtol(name, &end, 10);
+		if (*name != '\0' && *end == '\0')
+			return index >= 0 && index < count ? (int)index : -1;
+
+		//Names are compared ignoring case, spaces and dashes, so "floyd-steinberg" and "FloydSteinberg" both work
+		for (int i = 0; i < count; i++)
+		{
+			const char *a = name;
+			const char *b = algorithms[i].name;
+			while (true)
+			{
+				while (*a == ' ' || *a == '-' || *a == '_')
+					a++;
+				while (*b == ' ' || *b == '-' || *b == '_')
+					b++;
+				if (*a == '\0' || *b == '\0' || tolower((unsigned char)*a) != tolower((unsigned char)*b))
+					break;
+				a++;
+				b++;
+			}
+			if (*a == '\0' && *b == '\0')
+				return i;
+		}
+		return -1;
+	}
+
+	//Weighted chanels of the luminance, the sum is the same float as the per pixel formula of raylib without the divisions
+	struct LuminanceTables
+	{
+		float red[256];
+		float green[256];
+		float blue[256];
+
+		LuminanceTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				red[i] = i / 255.0f * 0.299f;
+				green[i] = i / 255.0f * 0.587f;
+				blue[i] = i / 255.0f * 0.114f;
+			}
+		}
+	};
+
+	void ConvertRowToGrayscale(const byte *pixels, Format format, byte *gray, int width, bool linear)
+	{
+		if (linear)
+		{
+			ConvertRowToLuminance(pixels, format, gray, width);
+			return;
+		}
+		if (format == Format::Grayscale)
+		{
+			memcpy(gray, pixels, width);
+			return;
+		}
+
+		static const LuminanceTables tables;
+		int bytesPerPixel = (int)format;
+		for (int x = 0; x < width; x++, pixels += bytesPerPixel)
+			gray[x] = (byte)((tables.red[pixels[0]] + tables.green[pixels[1]] + tables.blue[pixels[2]]) * 255.0f);
+	}
+
+	void ConvertToGrayscale(const PixelBuffer &source, PixelBuffer &gray, bool linear)
+	{
+		DITHER_TIME(Stage::Grayscale, (double)source.width * source.height / 1e6);
+		for (int y = 0; y < source.height; y++)
+			ConvertRowToGrayscale(source.data + (long long)y * source.stride, source.format, gray.data + (long long)y * gray.stride, source.width, linear);
+	}
+
+	bool Dither(byte *data, int width, int height, int stride, Format format, int algorithm, bool colored, const Settings &settings)
+	{
+		int bytesPerPixel = (int)format;
+		if (data == nullptr || width <= 0 || height <= 0 || stride < width * bytesPerPixel || algorithm < 0 || algorithm >= Kernels::GetAlgorithmCount())
+			return false;
+
+		DITHER_TIME(Stage::Dither, (double)width * height / 1e6);
+		const Kernels::Algorithm &selected = Kernels::GetAlgorithms()[algorithm];
+		if (colored || format == Format::Grayscale)
+		{
+			PixelBuffer buffer = {data, width, height, stride, format};
+			selected.kernel(buffer, settings);
+			return true;
+		}
+
+		//Same luminance as the grayscale conversion of raylib, so the library and the application give the same image
+		//The kernel converts every row right before dithering it
+		std::vector<byte> gray((size_t)width * height);
+		PixelBuffer source = {data, width, height, stride, format};
+		PixelBuffer buffer = {gray.data(), width, height, width, Format::Grayscale};
+		Settings fused = settings;
+		fused.source = &source;
+		selected.kernel(buffer, fused);
+
+		//The dithered gray goes back to the color chanels, alpha is left as it was
+		for (int y = 0; y < height; y++)
+		{
+			byte *pixel = data + (long long)y * stride;
+			const byte *grayRow = gray.data() + (size_t)y * width;
+			for (int x = 0; x < width; x++, pixel += bytesPerPixel)
+				pixel[0] = pixel[1] = pixel[2] = grayRow[x];
+		}
+		return true;
+	}
+
+	bool DitherInto(const PixelBuffer &source, PixelBuffer &destination, int algorithm, const Settings &settings)
+	{
+		if (source.data == nullptr || destination.data == nullptr || (destination.format != Format::Grayscale && destination.format != source.format) ||
+			source.width != destination.width || source.height != destination.height || source.width <= 0 || source.height <= 0 ||
+			source.stride < source.width * (int)source.format || destination.stride < destination.width * (int)destination.format ||
+			algorithm < 0 || algorithm >= Kernels::GetAlgorithmCount())
+			return false;
+
+		DITHER_TIME(Stage::Dither, (double)source.width * source.height / 1e6);
+		Settings fused = settings;
+		fused.source = &source;
+		PixelBuffer buffer = destination;
+		Kernels::GetAlgorithms()[algorithm].kernel(buffer, fused);
+		return true;
+	}
+
+	bool DitherResized(const PixelBuffer &source, PixelBuffer &destination, ResampleFilter filter, int algorithm, const Settings &settings)
+	{
+		if (source.data == nullptr || destination.data == nullptr || (destination.format != Format::Grayscale && destination.format != source.format) ||
+			source.width <= 0 || source.height <= 0 || destination.width <= 0 || destination.height <= 0 ||
+			source.stride < source.width * (int)source.format || destination.stride < destination.width * (int)destination.format ||
+			algorithm < 0 || algorithm >= Kernels::GetAlgorithmCount())
+			return false;
+
+		DITHER_TIME(Stage::Dither, (double)destination.width * destination.height / 1e6);
+		Resampler resampler(source, destination.width, destination.height, filter);
+		Settings fused = settings;
+		fused.source = nullptr;
+		fused.resampler = &resampler;
+		PixelBuffer buffer = destination;
+		Kernels::GetAlgorithms()[algorithm].kernel(buffer, fused);
+		return true;
+	}
+
+	StreamDitherer::StreamDitherer(int width, Format format, int algorithm, const Settings &settings)
+		: algorithm(Kernels::GetAlgorithms()[algorithm]), settings(settings),
+		  diffusion(Kernels::CreateDiffusionStream(this->algorithm, width, format, settings))
+	{
+	}
+
+	void StreamDitherer::DitherStrip(PixelBuffer &strip)
+	{
+		DITHER_TIME(Stage::Dither, (double)strip.width * strip.height / 1e6);
+		//Point-wise kernels only need the position of the strip, error diffusion continues with the errors of the rows above
+		strip.x = 0;
+		strip.y = nextRow;
+		if (diffusion)
+			diffusion->Run(strip, settings);
+		else
+			algorithm.kernel(strip, settings);
+		nextRow += strip.height;
+	}
+
+	void StreamDitherer::DitherStripInto(PixelBuffer &source, PixelBuffer &destination)
+	{
+		DITHER_TIME(Stage::Dither, (double)destination.width * destination.height / 1e6);
+		source.x = 0;
+		source.y = nextRow;
+		Settings fused = settings;
+		fused.source = &source;
+		destination.x = 0;
+		destination.y = nextRow;
+		if (diffusion)
+			diffusion->Run(destination, fused);
+		else
+			algorithm.kernel(destination, fused);
+		nextRow += destination.height;
+	}
+
+	std::vector<Tile> GetTiles(int width, int height, int tileSize, const Tile &focus)
+	{
+		std::vector<Tile> tiles;
+		for (int y = 0; y < height; y += tileSize)
+		{
+			for (int x = 0; x < width; x += tileSize)
+				tiles.push_back({x, y, x + tileSize < width ? tileSize : width - x, y + tileSize < height ? tileSize : height - y});
+		}
+
+		//Tiles in the focus go first, both groups are sorted by the distance of their centers to the center of the focus
+		auto overlaps = [&](const Tile &tile)
+		{
+			return tile.x < focus.x + focus.width && focus.x < tile.x + tile.width && tile.y < focus.y + focus.height && focus.y < tile.y + tile.height;
+		};
+		auto distance = [&](const Tile &tile)
+		{
+			long long dx = (tile.x * 2LL + tile.width) - (focus.x * 2LL + focus.width);
+			long long dy = (tile.y * 2LL + tile.height) - (focus.y * 2LL + focus.height);
+			return dx * dx + dy * dy;
+		};
+		std::stable_sort(tiles.begin(), tiles.end(), [&](const Tile &a, const Tile &b)
+		{
+			bool aFocused = overlaps(a);
+			bool bFocused = overlaps(b);
+			if (aFocused != bFocused)
+				return aFocused;
+			return distance(a) < distance(b);
+		});
+		return tiles;
+	}
+
+	bool DitherTiles(PixelBuffer &buffer, int algorithm, const std::vector<Tile> &tiles, const Settings &settings, const std::function<void(const Tile &)> &onTile)
+	{
+		if (algorithm < 0 || algorithm >= Kernels::GetAlgorithmCount() || !Kernels::GetAlgorithms()[algorithm].pointWise)
+			return false;
+
+		//Tiles are handed out in order, so the first ones are finished first, every tile runs on one thread
+		DITHER_TIME(Stage::Dither, (double)buffer.width * buffer.height / 1e6);
+		const Kernels::Algorithm &selected = Kernels::GetAlgorithms()[algorithm];
+		int threads = GetThreadCount(settings.threadCount);
+		GetThreadPool(threads)->ParallelFor((int)tiles.size(), 1, threads, [&](int begin, int end)
+		{
+			for (int i = begin; i < end && !IsCancelled(settings); i++)
+			{
+				const Tile &tile = tiles[i];
+				PixelBuffer part = buffer;
+				part.data = buffer.data + (long long)tile.y * buffer.stride + tile.x * (int)buffer.format;
+				part.width = tile.width;
+				part.height = tile.height;
+				part.x = buffer.x + tile.x;
+				part.y = buffer.y + tile.y;
+				DITHER_TRACE("Tile");
+				selected.kernel(part, settings);
+				//A cancelled kernel can stop in the middle of the tile
+				if (onTile && !IsCancelled(settings))
+					onTile(tile);
+			}
+		});
+		return true;
+	}
+}
@@ -0,0 +1,317 @@
+#include "kernels.h"
+#include "linearLight.h"
+#include "threshold.h"
+#include "threadPool.h"
+#include "palette.h"
+
+//Blue noise mask generated at build time by dither_bluenoise
+#include "blueNoise.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace Dithering
+{
+	Settings &GetSettings()
+	{
+		static Settings settings;
+		return settings;
+	}
+
+	namespace Kernels
+	{
+		//Integer hash with good avalanche (lowbias32), cheap enough to run for every byte and vectorizable
+		static inline unsigned int Mix(unsigned int h)
+		{
+			h ^= h >> 16;
+			h *= 0x7FEB352Du;
+			h ^= h >> 15;
+			h *= 0x846CA68Bu;
+			h ^= h >> 16;
+			return h;
+		}
+
+		//Moves every color chanel by its threshold (scaled to the distance between palette colors) and sets the pixel to the nearest palette color
+		//Thresholds are read the same way as by ThresholdRow, byte i of the row uses thresholds[i % period]
+		//In linear light the chanels are moved by the same part of the spread of linear light and encoded again for picking the color
+		template<Format F, bool Linear>
+		static void PaletteRow(byte *row, int width, const byte *thresholds, int period, const Palette &palette)
+		{
+			using Traits = FormatTraits<F>;
+			const int spread = palette.GetSpread();
+			const LinearTables &tables = GetLinearTables();
+			int offset = 0;
+			for (int x = 0; x < width; x++, row += Traits::bytesPerPixel)
+			{
+				int values[Traits::colorChannels];
+				for (int c = 0; c < Traits::colorChannels; c++)
+				{
+					int move = 128 - thresholds[(offset + c) % period];
+					if constexpr (Linear)
+					{
+						int value = tables.toLinear[row[c]] + move * spread * linearWhite / (255 * 256);
+						values[c] = tables.toSrgb[value < 0 ? 0 : value > linearWhite ? linearWhite : value];
+					}
+					else
+					{
+						int value = row[c] + move * spread / 256;
+						values[c] = value < 0 ? 0 : value > 255 ? 255 : value;
+					}
+				}
+				offset = (offset + Traits::bytesPerPixel) % period;
+
+				if constexpr (F == Format::Grayscale)
+					row[0] = palette.NearestGray(values[0]);
+				else
+				{
+					const Color &color = palette.GetColors()[palette.Nearest(values[0], values[1], values[2])];
+					row[0] = color.r;
+					row[1] = color.g;
+					row[2] = color.b;
+				}
+			}
+		}
+
+		template<Format F>
+		static void PaletteRow(byte *row, int width, const byte *thresholds, int period, const Palette &palette, bool linear)
+		{
+			if (linear)
+				PaletteRow<F, true>(row, width, thresholds, period, palette);
+			else
+				PaletteRow<F, false>(row, width, thresholds, period, palette);
+		}
+
+		static void PaletteRow(byte *row, int width, Format format, const byte *thresholds, int period, const Palette &palette, bool linear)
+		{
+			switch (format)
+			{
+				case Format::Grayscale:
+					PaletteRow<Format::Grayscale>(row, width, thresholds, period, palette, linear);
+					break;
+				case Format::R8G8B8:
+					PaletteRow<Format::R8G8B8>(row, width, thresholds, period, palette, linear);
+					break;
+				case Format::R8G8B8A8:
+					PaletteRow<Format::R8G8B8A8>(row, width, thresholds, period, palette, linear);
+					break;
+			}
+		}
+
+		template<Format F>
+		struct RandomKernel
+		{
+			//Random thresholds are a hash of seed, x, y and chanel, so any pixel can be computed on its own on any thread
+			static void Run(PixelBuffer &buffer, const Settings &settings)
+			{
+				using Traits = FormatTraits<F>;
+
+				int rowBytes = buffer.width * Traits::bytesPerPixel;
+				int period = (rowBytes + thresholdAlignment - 1) / thresholdAlignment * thresholdAlignment;
+				std::vector<byte> colorMask(period);
+				for (int i = 0; i < period; i++)
+					colorMask[i] = i % Traits::bytesPerPixel < Traits::colorChannels ? 255 : 0;
+
+				unsigned int seed = settings.seed;
+				//Black and white in linear light compares the encoded pixels with encoded thresholds
+				const byte *linearThresholds = settings.linear && settings.palette == nullptr ? GetLinearTables().thresholds : nullptr;
+				ParallelRows(settings.threadCount, buffer.height, [&](int begin, int end)
+				{
+					if (IsCancelled(settings))
+						return;
+					std::vector<byte> thresholds(period);
+					for (int y = begin; y < end; y++)
+					{
+						unsigned int rowKey = Mix(seed ^ Mix((unsigned int)(buffer.y + y) + 0x9E3779B9u));
+						byte *threshold = thresholds.data();
+						for (int x = 0; x < buffer.width; x++, threshold += Traits::bytesPerPixel)
+						{
+							for (int c = 0; c < Traits::bytesPerPixel; c++)
+								threshold[c] = (byte)(Mix(rowKey + (unsigned int)(buffer.x + x) * 4 + c) >> 24);
+						}
+						if (linearThresholds != nullptr)
+						{
+							for (int i = 0; i < rowBytes; i++)
+								thresholds[i] = linearThresholds[thresholds[i]];
+						}
+
+						LoadSourceRow(buffer, y, settings);
+						byte *row = buffer.data + (long long)y * buffer.stride;
+						if (settings.palette != nullptr)
+							PaletteRow<F>(row, buffer.width, thresholds.data(), period, *settings.palette, settings.linear);
+						else
+							ThresholdRow(row, row, rowBytes, thresholds.data(), colorMask.data(), period);
+					}
+					AddProgress(settings, end - begin);
+				});
+			}
+		};
+
+		void Random(PixelBuffer &buffer, const Settings &settings)
+		{
+			Dispatch<RandomKernel>(buffer, settings);
+		}
+
+		//Tables are built the first time a pattern is used with a format and a shift and then kept, so small images (and the tiles of the
+		//application) only do the compares, there are at most a few hundred of them
+		//Linear tables have the thresholds encoded as sRGB, so dithering in linear light costs nothing per pixel
+		static const ThresholdTable &GetThresholdTable(const byte *pattern, int patternSize, int shiftX, Format format, bool linear)
+		{
+			static std::mutex mutex;
+			static std::map<std::tuple<const byte *, int, Format, bool>, std::unique_ptr<ThresholdTable>> tables;
+			std::lock_guard<std::mutex> lock(mutex);
+			std::unique_ptr<ThresholdTable> &table = tables[std::make_tuple(pattern, shiftX, format, linear)];
+			if (table != nullptr)
+				return *table;
+
+			//A part of an image starts in the middle of the pattern, so the pattern columns are rotated to its first pixel
+			std::vector<byte> shifted(pattern, pattern + patternSize * patternSize);
+			if (shiftX != 0)
+			{
+				for (int i = 0; i < patternSize; i++)
+				{
+					for (int j = 0; j < patternSize; j++)
+						shifted[i * patternSize + j] = pattern[(i + shiftX) % patternSize * patternSize + j];
+				}
+			}
+			if (linear)
+			{
+				for (byte &threshold : shifted)
+					threshold = GetLinearTables().thresholds[threshold];
+			}
+			table.reset(new ThresholdTable(BuildThresholdTable(shifted.data(), patternSize, format)));
+			return *table;
+		}
+
+		void Ordered(PixelBuffer &buffer, const Settings &settings, const byte *pattern, int patternSize)
+		{
+			//The pattern is tiled once, every row is then a single vectorized compare
+			//Palettes move the pixels by the thresholds themselves
+			const ThresholdTable &table = GetThresholdTable(pattern, patternSize, buffer.x % patternSize, buffer.format,
+															settings.linear && settings.palette == nullptr);
+			int rowBytes = buffer.width * (int)buffer.format;
+			ParallelRows(settings.threadCount, buffer.height, [&](int begin, int end)
+			{
+				if (IsCancelled(settings))
+					return;
+				for (int y = begin; y < end; y++)
+				{
+					LoadSourceRow(buffer, y, settings);
+					byte *row = buffer.data + (long long)y * buffer.stride;
+					const byte *thresholds = table.thresholds.data() + ((buffer.y + y) % table.rows) * table.period;
+					if (settings.palette != nullptr)
+						PaletteRow(row, buffer.width, buffer.format, thresholds, table.period, *settings.palette, settings.linear);
+					else
+						ThresholdRow(row, row, rowBytes, thresholds, table.colorMask.data(), table.period);
+				}
+				AddProgress(settings, end - begin);
+			});
+		}
+
+		//Bayer matrix of any power of two size, built from the 1x1 matrix by M(2n) = [4M + 0, 4M + 2; 4M + 3, 4M + 1]
+		//The ranks are scaled to thresholds from 0 to 255, indexed as pattern[x * Size + y]
+		template<int Size>
+		struct BayerMatrix
+		{
+			static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Bayer matrices have a power of two size");
+
+			byte values[Size * Size] = {};
+
+			constexpr BayerMatrix()
+			{
+				for (int x = 0; x < Size; x++)
+				{
+					for (int y = 0; y < Size; y++)
+					{
+						//Every level of the recursion adds two bits to the rank, the lowest bits of x and y give the highest bits of the rank
+						int rank = 0;
+						for (int bit = 1; bit < Size; bit *= 2)
+						{
+							bool xBit = (x & bit) != 0;
+							bool yBit = (y & bit) != 0;
+							rank = rank * 4 + (xBit ? (yBit ? 1 : 3) : (yBit ? 2 : 0));
+						}
+						values[x * Size + y] = (byte)(rank * 256 / (Size * Size));
+					}
+				}
+			}
+		};
+
+		static constexpr BayerMatrix<2> bayer2x2;
+		static constexpr BayerMatrix<4> bayer4x4;
+		static constexpr BayerMatrix<8> bayer8x8;
+		static constexpr BayerMatrix<16> bayer16x16;
+		static constexpr BayerMatrix<32> bayer32x32;
+		static constexpr BayerMatrix<64> bayer64x64;
+
+		//Same values as the original hand written tables (where the 8x8 one had 22 in place of 88)
+		static_assert(bayer2x2.values[1] == 128 && bayer2x2.values[2] == 192 && bayer2x2.values[3] == 64, "2x2 Bayer matrix");
+		static_assert(bayer4x4.values[4] == 192 && bayer4x4.values[15] == 80, "4x4 Bayer matrix");
+		static_assert(bayer8x8.values[3 * 8 + 7] == 88 && bayer8x8.values[7 * 8 + 7] == 84, "8x8 Bayer matrix");
+
+		void Ordered2x2(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, bayer2x2.values, 2);
+		}
+
+		void Ordered4x4(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, bayer4x4.values, 4);
+		}
+
+		void Ordered8x8(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, bayer8x8.values, 8);
+		}
+
+		void Ordered16x16(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, bayer16x16.values, 16);
+		}
+
+		void Ordered32x32(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, bayer32x32.values, 32);
+		}
+
+		void Ordered64x64(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, bayer64x64.values, 64);
+		}
+
+		void BlueNoise(PixelBuffer &buffer, const Settings &settings)
+		{
+			Ordered(buffer, settings, blueNoiseMask, blueNoiseSize);
+		}
+
+		static const Algorithm algorithms[] = {
+			{"Random", Random, true},
+			{"Ordered 2x2", Ordered2x2, true},
+			{"Ordered 4x4", Ordered4x4, true},
+			{"Ordered 8x8", Ordered8x8, true},
+			{"Ordered 16x16", Ordered16x16, true},
+			{"Floyd-Steinberg", FloydSteinberg, false},
+			{"Jarvis-Judice-Ninke", JarvisJudiceNinke, false},
+			{"Stucki", Stucki, false},
+			{"Burkes", Burkes, false},
+			{"Sierra", Sierra, false},
+			{"Two-row Sierra", TwoRowSierra, false},
+			{"Sierra Lite", SierraLite, false},
+			{"Atkinson", Atkinson, false},
+			{"Ordered 32x32", Ordered32x32, true},
+			{"Ordered 64x64", Ordered64x64, true},
+			{"Blue noise", BlueNoise, true}};
+
+		const Algorithm *GetAlgorithms()
+		{
+			return algorithms;
+		}
+
+		int GetAlgorithmCount()
+		{
+			return sizeof(algorithms) / sizeof(Algorithm);
+		}
+	}
+}
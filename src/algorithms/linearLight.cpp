@@ -0,0 +1,65 @@
+#include "linearLight.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace Dithering
+{
+	static double DecodeSrgb(double value)
+	{
+		return value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+	}
+
+	static double EncodeSrgb(double value)
+	{
+		return value <= 0.0031308 ? value * 12.92 : 1.055 * pow(value, 1.0 / 2.4) - 0.055;
+	}
+
+	static LinearTables BuildLinearTables()
+	{
+		LinearTables tables;
+		for (int i = 0; i < 256; i++)
+		{
+			double linear = DecodeSrgb(i / 255.0);
+			tables.toLinear[i] = (uint16_t)lround(linear * linearWhite);
+			tables.red[i] = (uint32_t)lround(linear * linearWhite * 0.2126 * 65536.0);
+			tables.green[i] = (uint32_t)lround(linear * linearWhite * 0.7152 * 65536.0);
+			tables.blue[i] = (uint32_t)lround(linear * linearWhite * 0.0722 * 65536.0);
+		}
+		for (int i = 0; i <= linearWhite; i++)
+			tables.toSrgb[i] = (byte)lround(EncodeSrgb((double)i / linearWhite) * 255.0);
+
+		//The compare is value > threshold, so the threshold is the highest byte whose linear light isn't above t / 255 of white
+		for (int t = 0; t < 256; t++)
+		{
+			int threshold = 0;
+			while (threshold < 255 && tables.toLinear[threshold + 1] * 255 <= t * linearWhite)
+				threshold++;
+			tables.thresholds[t] = (byte)threshold;
+		}
+		return tables;
+	}
+
+	const LinearTables &GetLinearTables()
+	{
+		static const LinearTables tables = BuildLinearTables();
+		return tables;
+	}
+
+	void ConvertRowToLuminance(const byte *pixels, Format format, byte *gray, int width)
+	{
+		if (format == Format::Grayscale)
+		{
+			memcpy(gray, pixels, width);
+			return;
+		}
+
+		const LinearTables &tables = GetLinearTables();
+		int bytesPerPixel = (int)format;
+		for (int x = 0; x < width; x++, pixels += bytesPerPixel)
+		{
+			uint32_t luminance = (tables.red[pixels[0]] + tables.green[pixels[1]] + tables.blue[pixels[2]] + 32768) >> 16;
+			gray[x] = tables.toSrgb[luminance < (uint32_t)linearWhite ? luminance : linearWhite];
+		}
+	}
+}
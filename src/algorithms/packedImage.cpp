@@ -0,0 +1,164 @@
+#include "packedImage.h"
+#include "profiler.h"
+#include "threadPool.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace Dithering
+{
+	//Colors of an image, 1024 slots is enough for the 256 colors that can be packed
+	class ColorTable
+	{
+	public:
+		ColorTable() { memset(keys, 0, sizeof(keys)); }
+
+		//Adds a color (0xRRGGBB) if it isn't there yet, returns false when the table is full
+		bool Add(uint32_t color)
+		{
+			int slot = Find(color);
+			if (keys[slot] != 0)
+				return true;
+			if (count == maxColors)
+				return false;
+			keys[slot] = color | usedBit;
+			count++;
+			return true;
+		}
+
+		//Index of a color that was added
+		byte GetIndex(uint32_t color) const { return indices[Find(color)]; }
+
+		//Colors sorted by their value, the index of a color is its position in the list
+		std::vector<uint32_t> Sort()
+		{
+			std::vector<uint32_t> colors;
+			for (uint32_t key : keys)
+			{
+				if (key != 0)
+					colors.push_back(key & ~usedBit);
+			}
+			std::sort(colors.begin(), colors.end());
+			for (int i = 0; i < (int)colors.size(); i++)
+				indices[Find(colors[i])] = (byte)i;
+			return colors;
+		}
+
+	private:
+		static constexpr int slotBits = 10;
+		static constexpr int maxColors = 256;
+		static constexpr uint32_t usedBit = 1u << 24;
+
+		int Find(uint32_t color) const
+		{
+			int slot = (int)((color * 2654435761u) >> (32 - slotBits));
+			while (keys[slot] != 0 && keys[slot] != (color | usedBit))
+				slot = (slot + 1) & ((1 << slotBits) - 1);
+			return slot;
+		}
+
+		uint32_t keys[1 << slotBits];
+		byte indices[1 << slotBits] = {};
+		int count = 0;
+	};
+
+	static uint32_t GetColor(const byte *pixel, int channels)
+	{
+		if (channels == 1)
+			return pixel[0] * 0x010101u;
+		return (uint32_t)pixel[0] << 16 | (uint32_t)pixel[1] << 8 | pixel[2];
+	}
+
+	bool PackImage(const PixelBuffer &image, PackedImage &packed, int threadCount)
+	{
+		int channels = (int)image.format;
+		if (image.width <= 0 || image.height <= 0)
+			return false;
+		DITHER_TIME(Stage::Pack, (double)image.width * image.height / 1e6);
+
+		//Dithered pixels repeat a lot, the previous color is checked before the table
+		ColorTable table;
+		uint32_t previous = GetColor(image.data, channels);
+		if (!table.Add(previous))
+			return false;
+		for (int y = 0; y < image.height; y++)
+		{
+			const byte *row = image.data + (long long)y * image.stride;
+			for (int x = 0; x < image.width; x++)
+			{
+				const byte *pixel = row + x * channels;
+				if (channels == 4 && pixel[3] != 255)
+					return false;
+				uint32_t color = GetColor(pixel, channels);
+				if (color != previous && !table.Add(color))
+					return false;
+				previous = color;
+			}
+		}
+
+		std::vector<uint32_t> colors = table.Sort();
+		packed.width = image.width;
+		packed.height = image.height;
+		packed.bitsPerPixel = colors.size() <= 2 ? 1 : colors.size() <= 4 ? 2 : colors.size() <= 16 ? 4 : 8;
+		packed.stride = (image.width * packed.bitsPerPixel + 7) / 8;
+		packed.gray = image.format == Format::Grayscale;
+		packed.colors.clear();
+		for (uint32_t color : colors)
+			packed.colors.push_back({(byte)(color >> 16), (byte)(color >> 8), (byte)color});
+		packed.data.assign((size_t)packed.stride * packed.height, 0);
+
+		int bits = packed.bitsPerPixel;
+		ParallelRows(threadCount, image.height, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; y++)
+			{
+				const byte *row = image.data + (long long)y * image.stride;
+				byte *destination = packed.data.data() + (size_t)y * packed.stride;
+				//Pixels are shifted into an accumulator that is written out when a byte is full
+				int accumulator = 0;
+				int filled = 0;
+				for (int x = 0; x < image.width; x++)
+				{
+					accumulator = accumulator << bits | table.GetIndex(GetColor(row + x * channels, channels));
+					filled += bits;
+					if (filled == 8)
+					{
+						*destination++ = (byte)accumulator;
+						accumulator = 0;
+						filled = 0;
+					}
+				}
+				if (filled != 0)
+					*destination = (byte)(accumulator << (8 - filled));
+			}
+		});
+		return true;
+	}
+
+	void UnpackImage(const PackedImage &packed, PixelBuffer &destination, int threadCount)
+	{
+		int channels = (int)destination.format;
+		ParallelRows(threadCount, packed.height, [&](int begin, int end)
+		{
+			for (int y = begin; y < end; y++)
+			{
+				byte *row = destination.data + (long long)y * destination.stride;
+				for (int x = 0; x < packed.width; x++)
+				{
+					const Color &color = packed.colors[packed.GetIndex(x, y)];
+					byte *pixel = row + x * channels;
+					if (channels == 1)
+						pixel[0] = color.r;
+					else
+					{
+						pixel[0] = color.r;
+						pixel[1] = color.g;
+						pixel[2] = color.b;
+						if (channels == 4)
+							pixel[3] = 255;
+					}
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,355 @@
+#include "palette.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+
+namespace Dithering
+{
+	//Same luminance as the grayscale conversion of raylib
+	static int Luminance(const Color &color)
+	{
+		return (int)((color.r / 255.0f * 0.299f + color.g / 255.0f * 0.587f + color.b / 255.0f * 0.114f) * 255.0f);
+	}
+
+	Palette::Palette(std::vector<Color> paletteColors) : colors(std::move(paletteColors))
+	{
+		if (colors.size() > 256)
+			colors.resize(256);
+		if (colors.empty())
+			colors = {{0, 0, 0}, {255, 255, 255}};
+		const int count = (int)colors.size();
+
+		//Grayscale images are dithered to the luminance of the colors
+		for (int value = 0; value < 256; value++)
+		{
+			int best = 0;
+			for (int i = 1; i < count; i++)
+			{
+				if (abs(Luminance(colors[i]) - value) < abs(Luminance(colors[best]) - value))
+					best = i;
+			}
+			grayLevels[value] = (byte)Luminance(colors[best]);
+		}
+
+		//The thresholds have to move a pixel about as far as the next color, or flat areas never get a pattern
+		if (count > 1)
+		{
+			long long sum = 0;
+			for (int i = 0; i < count; i++)
+			{
+				int nearest = 255;
+				for (int j = 0; j < count; j++)
+				{
+					int distance = std::max({abs(colors[i].r - colors[j].r), abs(colors[i].g - colors[j].g), abs(colors[i].b - colors[j].b)});
+					if (j != i && distance > 0 && distance < nearest)
+						nearest = distance;
+				}
+				sum += nearest;
+			}
+			spread = (int)(sum / count);
+		}
+
+		//A color can be the nearest one to some point of a cell only if its distance to the cell is at most
+		//the smallest distance any color has to the farthest corner of the cell
+		constexpr int cells = 1 << cellBits;
+		constexpr int cellSize = 1 << cellShift;
+		cellStart.resize(cells * cells * cells + 1);
+		std::vector<int> nearDistance(count);
+		for (int cell = 0; cell < cells * cells * cells; cell++)
+		{
+			int low[3] = {(cell >> (cellBits * 2)) * cellSize, (cell >> cellBits & (cells - 1)) * cellSize, (cell & (cells - 1)) * cellSize};
+			int limit = INT32_MAX;
+			for (int i = 0; i < count; i++)
+			{
+				int channels[3] = {colors[i].r, colors[i].g, colors[i].b};
+				int near = 0, far = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int high = low[c] + cellSize - 1;
+					int outside = channels[c] < low[c] ? low[c] - channels[c] : channels[c] > high ? channels[c] - high : 0;
+					int farthest = std::max(abs(channels[c] - low[c]), abs(channels[c] - high));
+					near += outside * outside;
+					far += farthest * farthest;
+				}
+				nearDistance[i] = near;
+				limit = std::min(limit, far);
+			}
+
+			cellStart[cell] = (uint32_t)candidates.size();
+			for (int i = 0; i < count; i++)
+			{
+				if (nearDistance[i] <= limit)
+					candidates.push_back((byte)i);
+			}
+		}
+		cellStart[cells * cells * cells] = (uint32_t)candidates.size();
+	}
+
+	//Built in palettes
+	struct NamedPalette
+	{
+		const char *name;
+		std::vector<Color> colors;
+	};
+
+	static const std::vector<NamedPalette> &GetNamedPalettes()
+	{
+		static const std::vector<NamedPalette> palettes = {
+			{"bw", {{0, 0, 0}, {255, 255, 255}}},
+			{"gray4", {{0, 0, 0}, {85, 85, 85}, {170, 170, 170}, {255, 255, 255}}},
+			{"gray16", {{0, 0, 0}, {17, 17, 17}, {34, 34, 34}, {51, 51, 51}, {68, 68, 68}, {85, 85, 85}, {102, 102, 102}, {119, 119, 119},
+						{136, 136, 136}, {153, 153, 153}, {170, 170, 170}, {187, 187, 187}, {204, 204, 204}, {221, 221, 221}, {238, 238, 238}, {255, 255, 255}}},
+			{"rgb8", {{0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}}},
+			{"cga", {{0, 0, 0}, {85, 255, 255}, {255, 85, 255}, {255, 255, 255}}},
+			{"gameboy", {{15, 56, 15}, {48, 98, 48}, {139, 172, 15}, {155, 188, 15}}},
+			{"pico8", {{0, 0, 0}, {29, 43, 83}, {126, 37, 83}, {0, 135, 81}, {171, 82, 54}, {95, 87, 79}, {194, 195, 199}, {255, 241, 232},
+					   {255, 0, 77}, {255, 163, 0}, {255, 236, 39}, {0, 228, 54}, {41, 173, 255}, {131, 118, 156}, {255, 119, 168}, {255, 204, 170}}}};
+		return palettes;
+	}
+
+	//Parses #rrggbb (the # is optional)
+	static bool ParseHexColor(const char *text, Color &color)
+	{
+		if (*text == '#')
+			text++;
+		if (strlen(text) != 6)
+			return false;
+		for (int i = 0; i < 6; i++)
+		{
+			if (!isxdigit((unsigned char)text[i]))
+				return false;
+		}
+		unsigned long value = strtoul(text, nullptr, 16);
+		color = {(byte)(value >> 16), (byte)(value >> 8), (byte)value};
+		return true;
+	}
+
+	//Reads a file with one hex color per line, or a GIMP palette ("r g b name" lines after the header)
+	static bool LoadPaletteFile(const char *path, std::vector<Color> &colors)
+	{
+		FILE *file = fopen(path, "r");
+		if (file == nullptr)
+			return false;
+
+		char line[256];
+		while (fgets(line, sizeof(line), file) != nullptr)
+		{
+			char *text = line;
+			while (isspace((unsigned char)*text))
+				text++;
+			text[strcspn(text, "\r\n")] = '\0';
+
+			int r, g, b;
+			Color color;
+			char hex[8];
+			if (*text == '\0' || *text == ';' || (*text == '#' && strlen(text) != 7) || strncmp(text, "GIMP", 4) == 0 ||
+				strncmp(text, "Name:", 5) == 0 || strncmp(text, "Columns:", 8) == 0)
+				continue;
+			if (sscanf(text, "%d %d %d", &r, &g, &b) == 3)
+				colors.push_back({(byte)std::clamp(r, 0, 255), (byte)std::clamp(g, 0, 255), (byte)std::clamp(b, 0, 255)});
+			else if (sscanf(text, "%7s", hex) == 1 && ParseHexColor(hex, color))
+				colors.push_back(color);
+		}
+		fclose(file);
+		return !colors.empty();
+	}
+
+	bool ParsePaletteSpec(const char *text, PaletteSpec &spec)
+	{
+		spec = PaletteSpec();
+		std::string value = text;
+
+		for (const NamedPalette &palette : GetNamedPalettes())
+		{
+			if (value == palette.name)
+			{
+				spec.colors = palette.colors;
+				return true;
+			}
+		}
+
+		//Colors extracted from every image
+		for (const char *prefix : {"median:", "kmeans:"})
+		{
+			if (value.compare(0, strlen(prefix), prefix) == 0)
+			{
+				spec.extractCount = atoi(value.c_str() + strlen(prefix));
+				spec.method = prefix[0] == 'm' ? PaletteMethod::MedianCut : PaletteMethod::KMeans;
+				return spec.extractCount >= 2 && spec.extractCount <= 256;
+			}
+		}
+
+		//List of hex colors
+		Color color;
+		if (ParseHexColor(value.substr(0, value.find(',')).c_str(), color))
+		{
+			size_t start = 0;
+			while (start <= value.size())
+			{
+				size_t end = value.find(',', start);
+				if (end == std::string::npos)
+					end = value.size();
+				if (!ParseHexColor(value.substr(start, end - start).c_str(), color))
+					return false;
+				spec.colors.push_back(color);
+				start = end + 1;
+			}
+			return spec.colors.size() >= 2 && spec.colors.size() <= 256;
+		}
+
+		return LoadPaletteFile(text, spec.colors) && spec.colors.size() >= 2 && spec.colors.size() <= 256;
+	}
+
+	//Box of sample colors for the median cut
+	struct ColorBox
+	{
+		int begin;
+		int end;
+		int range;	 //Size of the widest chanel
+		int channel; //Widest chanel
+	};
+
+	static ColorBox MakeBox(const std::vector<Color> &samples, int begin, int end)
+	{
+		byte low[3] = {255, 255, 255}, high[3] = {0, 0, 0};
+		for (int i = begin; i < end; i++)
+		{
+			const byte channels[3] = {samples[i].r, samples[i].g, samples[i].b};
+			for (int c = 0; c < 3; c++)
+			{
+				low[c] = std::min(low[c], channels[c]);
+				high[c] = std::max(high[c], channels[c]);
+			}
+		}
+		ColorBox box = {begin, end, -1, 0};
+		for (int c = 0; c < 3; c++)
+		{
+			if (high[c] - low[c] > box.range)
+			{
+				box.range = high[c] - low[c];
+				box.channel = c;
+			}
+		}
+		return box;
+	}
+
+	static byte Channel(const Color &color, int channel)
+	{
+		return channel == 0 ? color.r : channel == 1 ? color.g : color.b;
+	}
+
+	//Splits the box with the widest range at the median of its widest chanel until there are count boxes, the colors are the box averages
+	static std::vector<Color> MedianCut(std::vector<Color> &samples, int count)
+	{
+		std::vector<ColorBox> boxes = {MakeBox(samples, 0, (int)samples.size())};
+		while ((int)boxes.size() < count)
+		{
+			ColorBox *widest = nullptr;
+			for (ColorBox &box : boxes)
+			{
+				if (box.end - box.begin >= 2 && box.range > 0 && (widest == nullptr || box.range > widest->range))
+					widest = &box;
+			}
+			//Every box has only one color left
+			if (widest == nullptr)
+				break;
+
+			ColorBox box = *widest;
+			int middle = (box.begin + box.end) / 2;
+			std::nth_element(samples.begin() + box.begin, samples.begin() + middle, samples.begin() + box.end, [&](const Color &a, const Color &b)
+			{
+				return Channel(a, box.channel) < Channel(b, box.channel);
+			});
+			*widest = MakeBox(samples, box.begin, middle);
+			boxes.push_back(MakeBox(samples, middle, box.end));
+		}
+
+		std::vector<Color> colors;
+		for (const ColorBox &box : boxes)
+		{
+			long long sum[3] = {0, 0, 0};
+			for (int i = box.begin; i < box.end; i++)
+			{
+				sum[0] += samples[i].r;
+				sum[1] += samples[i].g;
+				sum[2] += samples[i].b;
+			}
+			int size = box.end - box.begin;
+			colors.push_back({(byte)((sum[0] + size / 2) / size), (byte)((sum[1] + size / 2) / size), (byte)((sum[2] + size / 2) / size)});
+		}
+		return colors;
+	}
+
+	//Lloyd iterations starting from the median cut colors
+	static void KMeans(const std::vector<Color> &samples, std::vector<Color> &colors, int iterations)
+	{
+		std::vector<long long> sums(colors.size() * 4);
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			//The lookup structure makes the assignment cheap even for 256 colors
+			Palette palette(colors);
+			std::fill(sums.begin(), sums.end(), 0);
+			for (const Color &sample : samples)
+			{
+				long long *sum = sums.data() + palette.Nearest(sample.r, sample.g, sample.b) * 4;
+				sum[0] += sample.r;
+				sum[1] += sample.g;
+				sum[2] += sample.b;
+				sum[3]++;
+			}
+
+			bool changed = false;
+			for (size_t i = 0; i < colors.size(); i++)
+			{
+				const long long *sum = sums.data() + i * 4;
+				//Colors without samples stay where they are
+				if (sum[3] == 0)
+					continue;
+				Color mean = {(byte)((sum[0] + sum[3] / 2) / sum[3]), (byte)((sum[1] + sum[3] / 2) / sum[3]), (byte)((sum[2] + sum[3] / 2) / sum[3])};
+				changed |= mean.r != colors[i].r || mean.g != colors[i].g || mean.b != colors[i].b;
+				colors[i] = mean;
+			}
+			if (!changed)
+				break;
+		}
+	}
+
+	std::vector<Color> ExtractPalette(const PixelBuffer &image, int count, PaletteMethod method)
+	{
+		//An evenly spread subsample is enough to find the main colors and keeps big images fast
+		constexpr long long maxSamples = 1 << 16;
+		long long pixels = (long long)image.width * image.height;
+		long long step = std::max(1LL, pixels / maxSamples);
+		int bytesPerPixel = (int)image.format;
+
+		std::vector<Color> samples;
+		samples.reserve((size_t)std::min(pixels, maxSamples + 1));
+		for (long long i = 0; i < pixels; i += step)
+		{
+			const byte *pixel = image.data + (i / image.width) * image.stride + (i % image.width) * bytesPerPixel;
+			if (image.format == Format::Grayscale)
+				samples.push_back({pixel[0], pixel[0], pixel[0]});
+			else
+				samples.push_back({pixel[0], pixel[1], pixel[2]});
+		}
+		if (samples.empty())
+			return {};
+
+		std::vector<Color> colors = MedianCut(samples, count);
+		if (method == PaletteMethod::KMeans)
+			KMeans(samples, colors, 8);
+		return colors;
+	}
+
+	Palette MakePalette(const PaletteSpec &spec, const PixelBuffer &image)
+	{
+		if (spec.extractCount > 0)
+			return Palette(ExtractPalette(image, spec.extractCount, spec.method));
+		return Palette(spec.colors);
+	}
+}
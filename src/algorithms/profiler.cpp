@@ -0,0 +1,117 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace Dithering
+{
+	const char *GetStageName(Stage stage)
+	{
+		static const char *names[] = {"Load", "Grayscale", "Dither", "Pack", "Upload", "Save"};
+		return stage < Stage::Count ? names[(int)stage] : "";
+	}
+
+	namespace Profiler
+	{
+		//Finished timer of the trace
+		struct TraceEvent
+		{
+			const char *name;
+			int thread;
+			Clock::time_point start;
+			Clock::time_point end;
+			double megapixels;
+		};
+
+		static constexpr size_t maxTraceEvents = 1 << 20;
+
+		static std::mutex mutex;
+		static ProfileStats totals;
+		static std::atomic<bool> tracing{false};
+		static std::vector<TraceEvent> events;
+		static Clock::time_point traceStart;
+
+		//Small numbers for the tracks of the trace, the ids of std::thread aren't numbers
+		static int GetThreadNumber()
+		{
+			static std::atomic<int> nextNumber{1};
+			thread_local int number = nextNumber.fetch_add(1);
+			return number;
+		}
+
+		static void AddEvent(const char *name, Clock::time_point start, Clock::time_point end, double megapixels)
+		{
+			if (events.size() < maxTraceEvents)
+				events.push_back({name, GetThreadNumber(), start, end, megapixels});
+		}
+
+		void Record(Stage stage, Clock::time_point start, Clock::time_point end, double megapixels)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			StageStats &stats = totals.stages[(int)stage];
+			stats.count++;
+			stats.seconds += std::chrono::duration<double>(end - start).count();
+			stats.megapixels += megapixels;
+			if (tracing)
+				AddEvent(GetStageName(stage), start, end, megapixels);
+		}
+
+		void RecordTrace(const char *name, Clock::time_point start, Clock::time_point end)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (tracing)
+				AddEvent(name, start, end, 0.0);
+		}
+
+		ProfileStats GetStats()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return totals;
+		}
+
+		void Reset()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			totals = {};
+		}
+
+		void StartTrace()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			events.clear();
+			traceStart = Clock::now();
+			tracing = true;
+		}
+
+		bool IsTracing()
+		{
+			return tracing.load(std::memory_order_relaxed);
+		}
+
+		bool SaveTrace(const char *path)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			FILE *file = fopen(path, "w");
+			if (file == nullptr)
+				return false;
+
+			//Complete events ("ph":"X") with the times in microseconds since the trace was started
+			fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+			for (size_t i = 0; i < events.size(); i++)
+			{
+				const TraceEvent &event = events[i];
+				double start = std::chrono::duration<double, std::micro>(event.start - traceStart).count();
+				double duration = std::chrono::duration<double, std::micro>(event.end - event.start).count();
+				fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"dither\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", i == 0 ? "" : ",",
+						event.name, event.thread, start, duration);
+				if (event.megapixels > 0.0)
+					fprintf(file, ",\"args\":{\"megapixels\":%.6f}", event.megapixels);
+				fputc('}', file);
+			}
+			fprintf(file, "\n]}\n");
+			return fclose(file) == 0;
+		}
+	}
+}
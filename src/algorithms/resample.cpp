@@ -0,0 +1,171 @@
+#include "resample.h"
+
+#include <math.h>
+#include <strings.h>
+
+namespace Dithering
+{
+	bool ParseResampleFilter(const char *text, ResampleFilter &filter)
+	{
+		if (strcasecmp(text, "box") == 0)
+			filter = ResampleFilter::Box;
+		else if (strcasecmp(text, "bilinear") == 0)
+			filter = ResampleFilter::Bilinear;
+		else if (strcasecmp(text, "lanczos") == 0)
+			filter = ResampleFilter::Lanczos;
+		else
+			return false;
+		return true;
+	}
+
+	void GetResizedSize(int width, int height, int targetWidth, int targetHeight, int &resizedWidth, int &resizedHeight)
+	{
+		resizedWidth = targetWidth > 0 ? targetWidth : width;
+		resizedHeight = targetHeight > 0 ? targetHeight : height;
+		if (targetWidth > 0 && targetHeight <= 0)
+			resizedHeight = (int)((long long)height * targetWidth * 2 / width + 1) / 2;
+		else if (targetHeight > 0 && targetWidth <= 0)
+			resizedWidth = (int)((long long)width * targetHeight * 2 / height + 1) / 2;
+		resizedWidth = resizedWidth > 0 ? resizedWidth : 1;
+		resizedHeight = resizedHeight > 0 ? resizedHeight : 1;
+	}
+
+	//Radius of the filter in pixels of the bigger image
+	static double GetSupport(ResampleFilter filter)
+	{
+		switch (filter)
+		{
+			case ResampleFilter::Box:
+				return 0.5;
+			case ResampleFilter::Bilinear:
+				return 1.0;
+			default:
+				return 3.0;
+		}
+	}
+
+	static double Sinc(double x)
+	{
+		x *= M_PI;
+		return sin(x) / x;
+	}
+
+	static double GetWeight(ResampleFilter filter, double x)
+	{
+		switch (filter)
+		{
+			case ResampleFilter::Box:
+				return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+			case ResampleFilter::Bilinear:
+				return fabs(x) < 1.0 ? 1.0 - fabs(x) : 0.0;
+			default:
+				if (x == 0.0)
+					return 1.0;
+				return fabs(x) < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+		}
+	}
+
+	Resampler::Taps Resampler::ComputeTaps(int sourceSize, int targetSize, ResampleFilter filter)
+	{
+		//Shrinking widens the filter to the size of a target pixel, so every source pixel counts
+		double scale = (double)sourceSize / targetSize;
+		double filterScale = scale > 1.0 ? scale : 1.0;
+		double support = GetSupport(filter) * filterScale;
+
+		Taps taps;
+		taps.maxTaps = (int)ceil(support) * 2 + 1;
+		taps.start.resize(targetSize);
+		taps.count.resize(targetSize);
+		taps.weights.assign((size_t)targetSize * taps.maxTaps, 0.0f);
+		for (int i = 0; i < targetSize; i++)
+		{
+			//Centers of the pixels are at half pixels, the taps are cut at the edges and the rest is normalized
+			double center = (i + 0.5) * scale;
+			int begin = (int)(center - support + 0.5);
+			int end = (int)(center + support + 0.5);
+			begin = begin > 0 ? begin : 0;
+			end = end < sourceSize ? end : sourceSize;
+			end = end - begin < taps.maxTaps ? end : begin + taps.maxTaps;
+
+			float *weights = taps.weights.data() + (size_t)i * taps.maxTaps;
+			double total = 0.0;
+			for (int j = begin; j < end; j++)
+			{
+				weights[j - begin] = (float)GetWeight(filter, (j + 0.5 - center) / filterScale);
+				total += weights[j - begin];
+			}
+			//Enlarging with a box can fall between two pixels, the nearest one is taken
+			if (total == 0.0)
+			{
+				int nearest = (int)center < sourceSize ? (int)center : sourceSize - 1;
+				begin = nearest;
+				end = nearest + 1;
+				weights[0] = 1.0f;
+				total = 1.0;
+			}
+			for (int j = 0; j < end - begin; j++)
+				weights[j] = (float)(weights[j] / total);
+			taps.start[i] = begin;
+			taps.count[i] = end - begin;
+		}
+		return taps;
+	}
+
+	Resampler::Resampler(const PixelBuffer &source, int width, int height, ResampleFilter filter)
+		: source(source), horizontal(ComputeTaps(source.width, width, filter)), vertical(ComputeTaps(source.height, height, filter))
+	{
+	}
+
+	void Resampler::ResampleRow(int y, int x, int width, byte *destination, Format format, bool linear) const
+	{
+		int channels = (int)source.format;
+		//Every thread keeps its rows, so rows can be resampled in parallel
+		thread_local std::vector<float> columns;
+		thread_local std::vector<byte> colors;
+
+		//Vertical pass over the source columns that the pixels x to x + width use
+		int first = horizontal.start[x];
+		int last = horizontal.start[x + width - 1] + horizontal.count[x + width - 1];
+		int values = (last - first) * channels;
+		columns.assign(values, 0.0f);
+		const float *rowWeights = vertical.weights.data() + (size_t)y * vertical.maxTaps;
+		for (int tap = 0; tap < vertical.count[y]; tap++)
+		{
+			const byte *row = source.data + (long long)(vertical.start[y] + tap) * source.stride + first * channels;
+			float weight = rowWeights[tap];
+			float *column = columns.data();
+			for (int i = 0; i < values; i++)
+				column[i] += weight * row[i];
+		}
+
+		//Horizontal pass, grayscale results are converted from the resampled colors
+		byte *output = destination;
+		if (format != source.format)
+		{
+			colors.resize((size_t)width * channels);
+			output = colors.data();
+		}
+		for (int i = 0; i < width; i++)
+		{
+			const float *weights = horizontal.weights.data() + (size_t)(x + i) * horizontal.maxTaps;
+			const float *column = columns.data() + (horizontal.start[x + i] - first) * channels;
+			for (int c = 0; c < channels; c++)
+			{
+				float sum = 0.0f;
+				for (int tap = 0; tap < horizontal.count[x + i]; tap++)
+					sum += weights[tap] * column[tap * channels + c];
+				//Lanczos overshoots at edges
+				sum = sum < 0.0f ? 0.0f : sum > 255.0f ? 255.0f : sum;
+				output[i * channels + c] = (byte)(sum + 0.5f);
+			}
+		}
+		if (format != source.format)
+			ConvertRowToGrayscale(colors.data(), source.format, destination, width, linear);
+	}
+
+	void LoadResampledRow(const PixelBuffer &buffer, int y, const Settings &settings)
+	{
+		settings.resampler->ResampleRow(buffer.y + y, buffer.x, buffer.width, buffer.data + (long long)y * buffer.stride, buffer.format,
+										settings.linear);
+	}
+}
@@ -0,0 +1,146 @@
+#include "threadPool.h"
+#include "profiler.h"
+
+#include <stdlib.h>
+
+namespace Dithering
+{
+	//Set while a thread is running ranges of a job, used to detect nested calls
+	static thread_local bool insideJob = false;
+
+	ThreadPool::ThreadPool(int threadCount)
+	{
+		for (int i = 1; i < threadCount; i++)
+			workers.emplace_back(&ThreadPool::WorkerLoop, this, i - 1);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &worker : workers)
+			worker.join();
+	}
+
+	void ThreadPool::ParallelFor(int count, int grain, int threads, const std::function<void(int, int)> &function)
+	{
+		if (count <= 0)
+			return;
+		if (grain < 1)
+			grain = 1;
+
+		//Run on this thread if there is nothing to split or the pool is already working on something
+		std::unique_lock<std::mutex> busyLock(busy, std::defer_lock);
+		if (workers.empty() || threads < 2 || count <= grain || insideJob || !busyLock.try_lock())
+		{
+			for (int begin = 0; begin < count; begin += grain)
+				function(begin, begin + grain < count ? begin + grain : count);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &function;
+			jobCount = count;
+			jobGrain = grain;
+			nextBegin = 0;
+			activeWorkers = threads - 1 < (int)workers.size() ? threads - 1 : (int)workers.size();
+			runningWorkers = activeWorkers;
+			generation++;
+		}
+		wake.notify_all();
+
+		RunRanges();
+
+		//Wait for the workers to finish their last ranges
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return runningWorkers == 0; });
+		job = nullptr;
+	}
+
+	void ThreadPool::RunRanges()
+	{
+		insideJob = true;
+		while (true)
+		{
+			int begin = nextBegin.fetch_add(jobGrain);
+			if (begin >= jobCount)
+				break;
+			(*job)(begin, begin + jobGrain < jobCount ? begin + jobGrain : jobCount);
+		}
+		insideJob = false;
+	}
+
+	void ThreadPool::WorkerLoop(int index)
+	{
+		unsigned seenGeneration = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+				if (stopping)
+					return;
+				seenGeneration = generation;
+				//Workers past the requested thread count sit this job out
+				if (index >= activeWorkers)
+					continue;
+			}
+
+			RunRanges();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--runningWorkers == 0)
+				finished.notify_one();
+		}
+	}
+
+	int GetThreadCount(int requested)
+	{
+		int count = requested;
+		if (count <= 0)
+		{
+			const char *environment = getenv("DITHER_THREADS");
+			count = environment != nullptr ? atoi(environment) : 0;
+		}
+		if (count <= 0)
+			count = (int)std::thread::hardware_concurrency();
+		return count > 0 ? count : 1;
+	}
+
+	std::shared_ptr<ThreadPool> GetThreadPool(int threadCount)
+	{
+		//Callers keep the old pool alive until they are done with it
+		static std::shared_ptr<ThreadPool> pool;
+		static std::mutex poolMutex;
+
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if (!pool || pool->GetThreadCount() < threadCount)
+			pool = std::make_shared<ThreadPool>(threadCount);
+		return pool;
+	}
+
+	void ParallelRows(int threadCount, int height, const std::function<void(int, int)> &function)
+	{
+		int threads = GetThreadCount(threadCount);
+		//A few bands per thread keeps the threads busy when some bands are slower
+		int bandHeight = height / (threads * 4);
+		bandHeight = bandHeight > 8 ? bandHeight : 8;
+#ifdef DITHER_PROFILE
+		//Every band is an event of the trace, so the work of the threads can be seen
+		if (Profiler::IsTracing())
+		{
+			GetThreadPool(threads)->ParallelFor(height, bandHeight, threads, [&](int begin, int end)
+			{
+				DITHER_TRACE("Rows");
+				function(begin, end);
+			});
+			return;
+		}
+#endif
+		GetThreadPool(threads)->ParallelFor(height, bandHeight, threads, function);
+	}
+}
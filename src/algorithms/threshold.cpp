@@ -0,0 +1,153 @@
+#include "threshold.h"
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DITHER_X86
+#endif
+
+namespace Dithering
+{
+	//Greatest common divisor used to find the tiling period
+	static int Gcd(int a, int b)
+	{
+		while (b != 0)
+		{
+			int t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+	template<Format F>
+	static void FillThresholdTable(ThresholdTable &table, const byte *pattern, int patternSize)
+	{
+		using Traits = FormatTraits<F>;
+
+		//The pattern row in bytes has to fit a whole number of times in the period
+		int patternBytes = patternSize * Traits::bytesPerPixel;
+		table.rows = patternSize;
+		table.period = patternBytes / Gcd(patternBytes, thresholdAlignment) * thresholdAlignment;
+		table.thresholds.resize(table.rows * table.period);
+		table.colorMask.resize(table.period);
+
+		for (int i = 0; i < table.period; i++)
+			table.colorMask[i] = i % Traits::bytesPerPixel < Traits::colorChannels ? 255 : 0;
+
+		for (int y = 0; y < table.rows; y++)
+		{
+			byte *row = table.thresholds.data() + y * table.period;
+			for (int i = 0; i < table.period; i++)
+				row[i] = pattern[(i / Traits::bytesPerPixel) % patternSize * patternSize + y];
+		}
+	}
+
+	ThresholdTable BuildThresholdTable(const byte *pattern, int patternSize, Format format)
+	{
+		ThresholdTable table;
+		switch (format)
+		{
+			case Format::Grayscale:
+				FillThresholdTable<Format::Grayscale>(table, pattern, patternSize);
+				break;
+			case Format::R8G8B8:
+				FillThresholdTable<Format::R8G8B8>(table, pattern, patternSize);
+				break;
+			case Format::R8G8B8A8:
+				FillThresholdTable<Format::R8G8B8A8>(table, pattern, patternSize);
+				break;
+		}
+		return table;
+	}
+
+	//Scalar version, also used for the tails of the vectorized versions
+	static void ThresholdRowScalar(const byte *in, byte *out, int count, const byte *thresholds, const byte *colorMask, int period, int offset)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			byte value = in[i] > thresholds[offset] ? 255 : 0;
+			out[i] = colorMask[offset] ? value : in[i];
+			if (++offset == period)
+				offset = 0;
+		}
+	}
+
+	static void ThresholdRowScalar(const byte *in, byte *out, int count, const byte *thresholds, const byte *colorMask, int period)
+	{
+		ThresholdRowScalar(in, out, count, thresholds, colorMask, period, 0);
+	}
+
+#ifdef DITHER_X86
+	//in > threshold is tested as saturate(in - threshold) != 0, SSE2 has no unsigned byte compare
+	__attribute__((target("sse2")))
+	static void ThresholdRowSSE2(const byte *in, byte *out, int count, const byte *thresholds, const byte *colorMask, int period)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		int offset = 0;
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i value = _mm_loadu_si128((const __m128i *)(in + i));
+			__m128i threshold = _mm_loadu_si128((const __m128i *)(thresholds + offset));
+			__m128i mask = _mm_loadu_si128((const __m128i *)(colorMask + offset));
+			__m128i notAbove = _mm_cmpeq_epi8(_mm_subs_epu8(value, threshold), zero);
+			//Alpha bytes keep their value, color bytes become 255 when above the threshold
+			__m128i result = _mm_or_si128(_mm_andnot_si128(mask, value), _mm_andnot_si128(notAbove, mask));
+			_mm_storeu_si128((__m128i *)(out + i), result);
+
+			offset += 16;
+			if (offset == period)
+				offset = 0;
+		}
+		ThresholdRowScalar(in + i, out + i, count - i, thresholds, colorMask, period, offset);
+	}
+
+	__attribute__((target("avx2")))
+	static void ThresholdRowAVX2(const byte *in, byte *out, int count, const byte *thresholds, const byte *colorMask, int period)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		int offset = 0;
+		int i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			__m256i value = _mm256_loadu_si256((const __m256i *)(in + i));
+			__m256i threshold = _mm256_loadu_si256((const __m256i *)(thresholds + offset));
+			__m256i mask = _mm256_loadu_si256((const __m256i *)(colorMask + offset));
+			__m256i notAbove = _mm256_cmpeq_epi8(_mm256_subs_epu8(value, threshold), zero);
+			__m256i result = _mm256_or_si256(_mm256_andnot_si256(mask, value), _mm256_andnot_si256(notAbove, mask));
+			_mm256_storeu_si256((__m256i *)(out + i), result);
+
+			offset += 32;
+			if (offset == period)
+				offset = 0;
+		}
+		ThresholdRowScalar(in + i, out + i, count - i, thresholds, colorMask, period, offset);
+	}
+#endif
+
+	using ThresholdRowFunction = void (*)(const byte *, byte *, int, const byte *, const byte *, int);
+
+	//Picks the implementation for the instruction set detected at startup
+	static ThresholdRowFunction SelectThresholdRow()
+	{
+		switch (GetIsa())
+		{
+#ifdef DITHER_X86
+			case Isa::AVX2:
+				return ThresholdRowAVX2;
+			case Isa::SSE2:
+				return ThresholdRowSSE2;
+#endif
+			default:
+				return ThresholdRowScalar;
+		}
+	}
+
+	static const ThresholdRowFunction thresholdRowFunction = SelectThresholdRow();
+
+	void ThresholdRow(const byte *in, byte *out, int count, const byte *thresholds, const byte *colorMask, int period)
+	{
+		thresholdRowFunction(in, out, count, thresholds, colorMask, period);
+	}
+}
@@ -0,0 +1,377 @@
+//Benchmark of all dithering kernels, runs without a window or a display
+//Usage: dither_bench [--sizes 1,10,100] [--threads 1,4] [--formats gray,rgb,rgba] [--algorithms all|name,...]
+//                    [--image path]... [--repeat n] [--csv] [--output path]
+
+//Standard headers
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+//Project specific headers
+#include "kernels.h"
+#include "cpu.h"
+#include "threadPool.h"
+#include "imageFile.h"
+
+using namespace Dithering;
+
+constexpr int exitUsage = 2;	//Invalid command line (the same as dither-cli)
+
+//Source image the kernels are run on
+struct BenchImage
+{
+	std::string name;
+	int width;
+	int height;
+	Format format;
+	std::vector<byte> pixels;
+};
+
+//One measured run
+struct BenchResult
+{
+	std::string image;
+	const char *algorithm;
+	Format format;
+	int width;
+	int height;
+	int threads;
+	double seconds;
+	double peakRssMb;
+};
+
+static const char *FormatName(Format format)
+{
+	switch (format)
+	{
+		case Format::Grayscale:
+			return "gray";
+		case Format::R8G8B8:
+			return "rgb";
+		default:
+			return "rgba";
+	}
+}
+
+//Format of a name of --formats, returns false for an unknown name
+static bool ParseFormat(const std::string &name, Format &format)
+{
+	for (Format known : {Format::Grayscale, Format::R8G8B8, Format::R8G8B8A8})
+	{
+		if (name == FormatName(known))
+		{
+			format = known;
+			return true;
+		}
+	}
+	return false;
+}
+
+//Text as the contents of a JSON string, or of a CSV field when csv is set (quotes are doubled)
+static std::string Escape(const std::string &text, bool csv)
+{
+	std::string escaped;
+	for (char c : text)
+	{
+		if (csv)
+		{
+			if (c == '"')
+				escaped += '"';
+			escaped += c;
+		}
+		else if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", c);
+			escaped += code;
+		}
+		else
+			escaped += c;
+	}
+	return escaped;
+}
+
+//Splits a comma separated list
+static std::vector<std::string> SplitList(const char *text)
+{
+	std::vector<std::string> items;
+	std::string current;
+	for (const char *c = text; ; c++)
+	{
+		if (*c == ',' || *c == '\0')
+		{
+			if (!current.empty())
+				items.push_back(current);
+			current.clear();
+			if (*c == '\0')
+				break;
+		}
+		else
+			current += *c;
+	}
+	return items;
+}
+
+//Synthetic image with smooth gradients and some fine detail, so every kernel has real work to do
+static BenchImage MakeSyntheticImage(double megapixels, Format format)
+{
+	BenchImage image;
+	image.width = (int)(sqrt(megapixels * 1e6 * 4.0 / 3.0));
+	image.height = (int)(megapixels * 1e6 / image.width);
+	image.format = format;
+	image.name = "synthetic";
+
+	int bytesPerPixel = (int)format;
+	image.pixels.resize((size_t)image.width * image.height * bytesPerPixel);
+	unsigned int noise = 1;
+	for (int y = 0; y < image.height; y++)
+	{
+		byte *pixel = image.pixels.data() + (size_t)y * image.width * bytesPerPixel;
+		for (int x = 0; x < image.width; x++, pixel += bytesPerPixel)
+		{
+			noise = noise * 1664525u + 1013904223u;
+			int detail = (int)(noise >> 28) - 8;
+			int values[4] = {x * 255 / image.width + detail, y * 255 / image.height + detail, (x + y) * 255 / (image.width + image.height) + detail, 255};
+			for (int c = 0; c < bytesPerPixel; c++)
+				pixel[c] = (byte)(values[c] < 0 ? 0 : values[c] > 255 ? 255 : values[c]);
+		}
+	}
+	return image;
+}
+
+//Loads an image file converted to the requested format
+static bool LoadBenchImage(const char *path, Format format, BenchImage &image)
+{
+	ImageFile file;
+	if (!LoadImageFile(path, format, file))
+		return false;
+
+	image.name = path;
+	image.width = file.width;
+	image.height = file.height;
+	image.format = format;
+	image.pixels = std::move(file.pixels);
+	return true;
+}
+
+//Resets the peak resident memory of the process (Linux only), so every run reports its own peak
+static void ResetPeakRss()
+{
+#if defined(__linux__)
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file != nullptr)
+	{
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
+
+//Peak resident memory in megabytes
+static double GetPeakRssMb()
+{
+#if defined(__linux__)
+	FILE *file = fopen("/proc/self/status", "r");
+	if (file != nullptr)
+	{
+		char line[256];
+		long kb = -1;
+		while (fgets(line, sizeof(line), file) != nullptr)
+		{
+			if (strncmp(line, "VmHWM:", 6) == 0)
+				kb = atol(line + 6);
+		}
+		fclose(file);
+		if (kb >= 0)
+			return kb / 1024.0;
+	}
+#endif
+#if !defined(_WIN32)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+#else
+	return 0.0;
+#endif
+}
+
+//Runs one algorithm on a copy of the image and keeps the fastest of the repeats
+static BenchResult Run(const BenchImage &image, const Kernels::Algorithm &algorithm, int threads, int repeat)
+{
+	Settings settings;
+	settings.threadCount = threads;
+	std::vector<byte> work(image.pixels.size());
+
+	BenchResult result = {image.name, algorithm.name, image.format, image.width, image.height, threads, 0.0, 0.0};
+	ResetPeakRss();
+	for (int i = 0; i < repeat; i++)
+	{
+		memcpy(work.data(), image.pixels.data(), work.size());
+		PixelBuffer buffer = {work.data(), image.width, image.height, image.width * (int)image.format, image.format};
+
+		auto start = std::chrono::steady_clock::now();
+		algorithm.kernel(buffer, settings);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (i == 0 || seconds < result.seconds)
+			result.seconds = seconds;
+	}
+	result.peakRssMb = GetPeakRssMb();
+	return result;
+}
+
+static void PrintResult(FILE *out, const BenchResult &result, bool csv, bool first)
+{
+	std::string image = Escape(result.image, csv);
+	double pixels = (double)result.width * result.height;
+	double mpPerSecond = pixels / 1e6 / result.seconds;
+	double nsPerPixel = result.seconds * 1e9 / pixels;
+	if (csv)
+	{
+		fprintf(out, "\"%s\",\"%s\",%s,%d,%d,%d,%.2f,%d,%s,%.6f,%.2f,%.3f,%.1f\n", image.c_str(), result.algorithm, FormatName(result.format),
+				result.format != Format::Grayscale, result.width, result.height, pixels / 1e6, result.threads, GetIsaName(GetIsa()),
+				result.seconds, mpPerSecond, nsPerPixel, result.peakRssMb);
+	}
+	else
+	{
+		fprintf(out, "%s\n  {\"image\": \"%s\", \"algorithm\": \"%s\", \"format\": \"%s\", \"colored\": %s, \"width\": %d, \"height\": %d, "
+				"\"megapixels\": %.2f, \"threads\": %d, \"isa\": \"%s\", \"seconds\": %.6f, \"mp_per_s\": %.2f, \"ns_per_pixel\": %.3f, \"peak_rss_mb\": %.1f}",
+				first ? "" : ",", image.c_str(), result.algorithm, FormatName(result.format), result.format != Format::Grayscale ? "true" : "false",
+				result.width, result.height, pixels / 1e6, result.threads, GetIsaName(GetIsa()), result.seconds, mpPerSecond, nsPerPixel, result.peakRssMb);
+	}
+	fflush(out);
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> sizes = {"1", "10", "100"};
+	std::vector<std::string> threadCounts = {"1", std::to_string(std::thread::hardware_concurrency())};
+	std::vector<std::string> formats = {"gray", "rgb", "rgba"};
+	std::vector<std::string> algorithmNames;
+	std::vector<const char *> imagePaths;
+	int repeat = 3;
+	bool csv = false;
+	const char *outputPath = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (strcmp(argv[i], "--csv") == 0)
+			csv = true;
+		else if (value == nullptr)
+		{
+			fprintf(stderr, "Unknown option or missing value for %s\n", argv[i]);
+			return exitUsage;
+		}
+		else if (strcmp(argv[i], "--sizes") == 0)
+			sizes = SplitList(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0)
+			threadCounts = SplitList(argv[++i]);
+		else if (strcmp(argv[i], "--formats") == 0)
+			formats = SplitList(argv[++i]);
+		else if (strcmp(argv[i], "--algorithms") == 0)
+			algorithmNames = strcmp(argv[++i], "all") == 0 ? std::vector<std::string>() : SplitList(argv[i]);
+		else if (strcmp(argv[i], "--image") == 0)
+			imagePaths.push_back(argv[++i]);
+		else if (strcmp(argv[i], "--repeat") == 0)
+			repeat = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+		else if (strcmp(argv[i], "--output") == 0)
+			outputPath = argv[++i];
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return exitUsage;
+		}
+	}
+
+	//Selected algorithms (all of them by default) in the order of the list, unknown names are errors like in dither-cli
+	std::vector<const Kernels::Algorithm *> algorithms;
+	for (int i = 0; i < Kernels::GetAlgorithmCount() && algorithmNames.empty(); i++)
+		algorithms.push_back(&Kernels::GetAlgorithms()[i]);
+	for (const std::string &name : algorithmNames)
+	{
+		const Kernels::Algorithm *found = nullptr;
+		for (int i = 0; i < Kernels::GetAlgorithmCount(); i++)
+		{
+			if (name == Kernels::GetAlgorithms()[i].name)
+				found = &Kernels::GetAlgorithms()[i];
+		}
+		if (found == nullptr)
+		{
+			fprintf(stderr, "Unknown algorithm %s\n", name.c_str());
+			return exitUsage;
+		}
+		algorithms.push_back(found);
+	}
+
+	std::vector<Format> imageFormats;
+	for (const std::string &name : formats)
+	{
+		Format format;
+		if (!ParseFormat(name, format))
+		{
+			fprintf(stderr, "Unknown format %s (gray, rgb or rgba)\n", name.c_str());
+			return exitUsage;
+		}
+		imageFormats.push_back(format);
+	}
+
+	FILE *out = outputPath != nullptr ? fopen(outputPath, "w") : stdout;
+	if (out == nullptr)
+	{
+		fprintf(stderr, "Can't open %s\n", outputPath);
+		return 1;
+	}
+
+	if (csv)
+		fprintf(out, "image,algorithm,format,colored,width,height,megapixels,threads,isa,seconds,mp_per_s,ns_per_pixel,peak_rss_mb\n");
+	else
+		fprintf(out, "[");
+
+	bool first = true;
+	for (Format format : imageFormats)
+	{
+		//Synthetic images of every size followed by the real images, every image only exists during its own runs,
+		//so the peak memory of a run doesn't include the other images
+		int imageCount = (int)(sizes.size() + imagePaths.size());
+		for (int i = 0; i < imageCount; i++)
+		{
+			BenchImage image;
+			if (i < (int)sizes.size())
+				image = MakeSyntheticImage(atof(sizes[i].c_str()), format);
+			else if (!LoadBenchImage(imagePaths[i - sizes.size()], format, image))
+			{
+				fprintf(stderr, "Can't load %s\n", imagePaths[i - sizes.size()]);
+				continue;
+			}
+
+			for (const Kernels::Algorithm *algorithm : algorithms)
+			{
+				for (const std::string &threads : threadCounts)
+				{
+					PrintResult(out, Run(image, *algorithm, atoi(threads.c_str()), repeat), csv, first);
+					first = false;
+				}
+			}
+		}
+	}
+
+	if (!csv)
+		fprintf(out, "\n]\n");
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
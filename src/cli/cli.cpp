@@ -0,0 +1,611 @@
+//Command line dithering, runs without a window or a display
+//Usage: dither-cli [options] <image>...
+
+//Standard headers
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Project specific headers
+#include "batch.h"
+#include "daemon.h"
+#include "dither.h"
+#include "imageFile.h"
+#include "profiler.h"
+
+using namespace Dithering;
+
+//Exit codes
+constexpr int exitSuccess = 0;		//Every file was dithered
+constexpr int exitFailedFiles = 1;	//Some files couldn't be loaded, dithered or saved
+constexpr int exitUsage = 2;		//Invalid command line
+constexpr int exitDaemon = 3;		//The daemon can't listen or the client can't connect to it
+
+struct Options
+{
+	int algorithm = 5;	//Floyd-Steinberg
+	bool colored = false;
+	Settings settings;
+	const char *outputDirectory = nullptr;
+	const char *suffix = "_processed";
+	const char *outputFormat = nullptr;
+	int jobs = 0;
+	int queueDepth = 0;
+	int stripRows = 0;
+	bool mapFiles = false;
+	RawLayout raw;
+	int resizeWidth = 0;
+	int resizeHeight = 0;
+	ResampleFilter filter = ResampleFilter::Lanczos;
+	PaletteSpec palette;
+	const char *paletteText = nullptr;
+	bool quiet = false;
+	bool stats = false;
+	const char *tracePath = nullptr;
+	const char *manifestPath = nullptr;
+	const char *serveSocket = nullptr;
+	const char *connectSocket = nullptr;
+	bool shutdownDaemon = false;
+	bool sequence = false;
+	int temporalThreshold = -1;
+	std::vector<const char *> inputs;
+};
+
+static void PrintUsage(FILE *out)
+{
+	fprintf(out,
+			"Usage: dither-cli [options] <image>...\n"
+			"\n"
+			"Dithers every image and saves it next to the input with a suffix.\n"
+			"Images are decoded, dithered and encoded at the same time, on different threads.\n"
+			"\n"
+			"Options:\n"
+			"  -a, --algorithm <name|n>  Algorithm name or number from --list (default Floyd-Steinberg)\n"
+			"  -c, --colored             Dither every color chanel instead of converting to grayscale\n"
+			"  -t, --threads <n>         Threads for dithering one image (default 0, uses DITHER_THREADS or all cores)\n"
+			"  -j, --jobs <n>            Threads of every stage of the pipeline (default 0, uses all cores)\n"
+			"      --queue <n>           Images that can wait between two stages (default the number of jobs)\n"
+			"      --stream <rows>       Streams netpbm files (pgm, ppm or pam to pbm, pgm, ppm or pam) in strips of rows,\n"
+			"                            so images bigger than the memory can be dithered (default 0, decodes whole images)\n"
+			"      --mmap                Maps netpbm files to memory and dithers them straight into a mapped pgm, ppm or pam\n"
+			"      --raw <w>x<h>x<c>     Size and chanels (1, 3 or 4) of .raw inputs, which are only pixels and always mapped\n"
+			"  -r, --resize <w>x<h>      Resizes the images to the size of the device as they are dithered, without storing the\n"
+			"                            resized image (0 for one side keeps the aspect ratio, like 800x0)\n"
+			"      --filter <name>       Resampling filter of --resize: box, bilinear or lanczos (default lanczos)\n"
+			"  -p, --palette <spec>      Dithers to a palette instead of black and white: bw, gray4, gray16, rgb8, cga,\n"
+			"                            gameboy, pico8, median:<n> or kmeans:<n> to extract n colors from every image,\n"
+			"                            hex colors (#000000,#ffffff) or a palette file (hex lines or GIMP .gpl)\n"
+			"  -m, --manifest <file>     Makes several results of every image, which is decoded only once: a text file with a\n"
+			"                            variant on every line, like \"algorithm=atkinson colored=1 palette=pico8 format=png\n"
+			"                            suffix=_pico8\" (keys: algorithm, colored, palette, resize, filter, format, suffix),\n"
+			"                            the other options are the defaults of the lines\n"
+			"      --serve <socket>      Runs as a daemon on a Unix domain socket: keeps the threads and buffers warm and dithers\n"
+			"                            the requests of clients (-j jobs at the same time) until a shutdown request or a signal\n"
+			"      --connect <socket>    Sends the images to a daemon instead of dithering them here (one variant, no manifest)\n"
+			"      --shutdown            With --connect, stops the daemon after the images (no images are needed then)\n"
+			"      --sequence            The inputs are frame sequences: directories of frames or numbered patterns like\n"
+			"                            frame_%%04d.png, the frames go through the pipeline in order and frames/s is printed\n"
+			"      --temporal <n>        Error diffusion keeps the result of the previous frame where no chanel of the source\n"
+			"                            changed by more than n (0 for unchanged pixels), so still parts don't flicker\n"
+			"  -s, --seed <n>            Seed of the random dithering (default 0)\n"
+			"      --serpentine          Error diffusion goes right to left on odd rows\n"
+			"      --linear              Dithers in linear light (gamma correct): thresholds and errors are linear, gray\n"
+			"                            is the luminance of linear light, so the tones keep their brightness\n"
+			"  -o, --output <dir>        Directory of the dithered images (default the directory of the input)\n"
+			"      --suffix <text>       Added to the file name of the output (default _processed)\n"
+			"  -f, --format <ext>        Output format: png, bmp, tga, jpg, pbm, pgm, ppm or raw (default the format of the input)\n"
+			"  -l, --list                Lists the algorithms and exits\n"
+			"      --stats               Prints the time of every stage (load, dither, pack, save) after the batch\n"
+			"      --trace <file>        Saves the stages of every thread as Chrome trace events (chrome://tracing or Perfetto)\n"
+			"  -q, --quiet               Prints only the errors\n"
+			"  -h, --help                Prints this help and exits\n"
+			"\n"
+			"Exit status: 0 when every file was dithered, 1 when some files failed, 2 on invalid usage, 3 when the daemon\n"
+			"can't listen or the client can't connect to it.\n");
+}
+
+static void PrintAlgorithms()
+{
+	for (int i = 0; i < Kernels::GetAlgorithmCount(); i++)
+		printf("%2d  %s\n", i, Kernels::GetAlgorithms()[i].name);
+}
+
+//Time of the stages summed over the threads of the pipeline, so it can be more than the time of the batch
+static void PrintStageStats()
+{
+	ProfileStats stats = Profiler::GetStats();
+	printf("%-10s %8s %12s %10s %8s\n", "Stage", "Calls", "Thread ms", "ms/call", "MP/s");
+	for (int i = 0; i < (int)Stage::Count; i++)
+	{
+		const StageStats &stage = stats.stages[i];
+		if (stage.count == 0)
+			continue;
+		printf("%-10s %8d %12.2f %10.3f ", GetStageName((Stage)i), stage.count, stage.seconds * 1000.0, stage.seconds * 1000.0 / stage.count);
+		//Stages that don't know the size of the image (loading a file) have no MP/s
+		if (stage.megapixels > 0.0)
+			printf("%8.1f\n", stage.MegapixelsPerSecond());
+		else
+			printf("%8s\n", "-");
+	}
+}
+
+//Parses a non negative integer, the whole text has to be a number
+static bool ParseNumber(const char *text, unsigned long &value)
+{
+	char *end;
+	value = strtoul(text, &end, 10);
+	return *text != '\0' && *text != '-' && *end == '\0';
+}
+
+//Path of the dithered image: <directory>/<name><suffix>.<extension>
+static std::string GetOutputPath(const char *input, const Options &options, const ManifestVariant &variant)
+{
+	std::string path = input;
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+	size_t dot = name.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : name.substr(dot);
+	if (dot != std::string::npos)
+		name.erase(dot);
+
+	if (!variant.format.empty())
+		extension = "." + variant.format;
+	//Inputs that can only be read (gif, psd, ...) are saved as png
+	else if (!IsSupportedOutput(extension.c_str()))
+		extension = ".png";
+
+	if (options.outputDirectory != nullptr)
+		directory = options.outputDirectory;
+	return directory + "/" + name + variant.suffix + extension;
+}
+
+//Returns exitSuccess or the exit code of the error
+static int ParseArguments(int argc, char **argv, Options &options)
+{
+	bool onlyInputs = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const char *argument = argv[i];
+		if (onlyInputs || argument[0] != '-' || argument[1] == '\0')
+		{
+			options.inputs.push_back(argument);
+			continue;
+		}
+
+		auto is = [&](const char *shortName, const char *longName)
+		{
+			return (shortName != nullptr && strcmp(argument, shortName) == 0) || strcmp(argument, longName) == 0;
+		};
+
+		//Flags without a value
+		if (strcmp(argument, "--") == 0)
+			onlyInputs = true;
+		else if (is("-h", "--help"))
+		{
+			PrintUsage(stdout);
+			exit(exitSuccess);
+		}
+		else if (is("-l", "--list"))
+		{
+			PrintAlgorithms();
+			exit(exitSuccess);
+		}
+		else if (is("-c", "--colored"))
+			options.colored = true;
+		else if (is(nullptr, "--serpentine"))
+			options.settings.serpentine = true;
+		else if (is(nullptr, "--linear"))
+			options.settings.linear = true;
+		else if (is(nullptr, "--mmap"))
+			options.mapFiles = true;
+		else if (is(nullptr, "--sequence"))
+			options.sequence = true;
+		else if (is(nullptr, "--shutdown"))
+			options.shutdownDaemon = true;
+		else if (is(nullptr, "--stats"))
+			options.stats = true;
+		else if (is("-q", "--quiet"))
+			options.quiet = true;
+		//Options with a value
+		else
+		{
+			const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+			bool known = is("-a", "--algorithm") || is("-t", "--threads") || is("-s", "--seed") || is("-j", "--jobs") ||
+						 is(nullptr, "--queue") || is(nullptr, "--stream") || is("-o", "--output") || is(nullptr, "--suffix") || is("-f", "--format") ||
+						 is("-p", "--palette") || is(nullptr, "--raw") || is(nullptr, "--trace") || is("-r", "--resize") || is(nullptr, "--filter") ||
+						 is("-m", "--manifest") || is(nullptr, "--serve") || is(nullptr, "--connect") ||
+						 is(nullptr, "--temporal");
+			if (!known)
+			{
+				fprintf(stderr, "dither-cli: unknown option %s\n", argument);
+				return exitUsage;
+			}
+			if (value == nullptr)
+			{
+				fprintf(stderr, "dither-cli: missing value for %s\n", argument);
+				return exitUsage;
+			}
+			i++;
+
+			unsigned long number;
+			if (is("-a", "--algorithm"))
+			{
+				options.algorithm = FindAlgorithm(value);
+				if (options.algorithm < 0)
+				{
+					fprintf(stderr, "dither-cli: unknown algorithm %s (see --list)\n", value);
+					return exitUsage;
+				}
+			}
+			else if (is("-t", "--threads") || is("-s", "--seed") || is("-j", "--jobs") || is(nullptr, "--queue") || is(nullptr, "--stream") ||
+					 is(nullptr, "--temporal"))
+			{
+				if (!ParseNumber(value, number))
+				{
+					fprintf(stderr, "dither-cli: %s needs a non negative number, got %s\n", argument, value);
+					return exitUsage;
+				}
+				if (is("-t", "--threads"))
+					options.settings.threadCount = (int)number;
+				else if (is("-s", "--seed"))
+					options.settings.seed = (unsigned int)number;
+				else if (is("-j", "--jobs"))
+					options.jobs = (int)number;
+				else if (is(nullptr, "--queue"))
+					options.queueDepth = (int)number;
+				else if (is(nullptr, "--temporal"))
+					options.temporalThreshold = number < 255 ? (int)number : 255;
+				else
+					options.stripRows = (int)number;
+			}
+			else if (is("-p", "--palette"))
+			{
+				if (!ParsePaletteSpec(value, options.palette))
+				{
+					fprintf(stderr, "dither-cli: invalid palette %s\n", value);
+					return exitUsage;
+				}
+				options.paletteText = value;
+			}
+			else if (is(nullptr, "--raw"))
+			{
+				int channels = 0;
+				char end;
+				if (sscanf(value, "%dx%dx%d%c", &options.raw.width, &options.raw.height, &channels, &end) != 3 || options.raw.width <= 0 ||
+					options.raw.height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+				{
+					fprintf(stderr, "dither-cli: invalid raw size %s, expected <width>x<height>x<1, 3 or 4>\n", value);
+					return exitUsage;
+				}
+				options.raw.format = (Format)channels;
+			}
+			else if (is("-r", "--resize"))
+			{
+				char end;
+				if (sscanf(value, "%dx%d%c", &options.resizeWidth, &options.resizeHeight, &end) != 2 || options.resizeWidth < 0 ||
+					options.resizeHeight < 0 || (options.resizeWidth == 0 && options.resizeHeight == 0))
+				{
+					fprintf(stderr, "dither-cli: invalid size %s, expected <width>x<height>\n", value);
+					return exitUsage;
+				}
+			}
+			else if (is(nullptr, "--filter"))
+			{
+				if (!ParseResampleFilter(value, options.filter))
+				{
+					fprintf(stderr, "dither-cli: unknown filter %s (box, bilinear or lanczos)\n", value);
+					return exitUsage;
+				}
+			}
+			else if (is("-m", "--manifest"))
+				options.manifestPath = value;
+			else if (is(nullptr, "--serve"))
+				options.serveSocket = value;
+			else if (is(nullptr, "--connect"))
+				options.connectSocket = value;
+			else if (is(nullptr, "--trace"))
+				options.tracePath = value;
+			else if (is("-o", "--output"))
+				options.outputDirectory = value;
+			else if (is(nullptr, "--suffix"))
+				options.suffix = value;
+			else
+			{
+				options.outputFormat = value[0] == '.' ? value + 1 : value;
+				if (!IsSupportedOutput((std::string(".") + options.outputFormat).c_str()))
+				{
+					fprintf(stderr, "dither-cli: unsupported output format %s\n", value);
+					return exitUsage;
+				}
+			}
+		}
+	}
+
+	if ((options.stats || options.tracePath != nullptr) && !Profiler::IsEnabled())
+		fprintf(stderr, "dither-cli: built without DITHER_PROFILE, --stats and --trace have nothing to show\n");
+	if (options.connectSocket != nullptr && options.manifestPath != nullptr)
+	{
+		fprintf(stderr, "dither-cli: --connect sends one variant, it can't be used with a manifest\n");
+		return exitUsage;
+	}
+	if (options.temporalThreshold >= 0 && !options.sequence)
+	{
+		fprintf(stderr, "dither-cli: --temporal needs --sequence\n");
+		return exitUsage;
+	}
+	if (options.shutdownDaemon && options.connectSocket == nullptr)
+	{
+		fprintf(stderr, "dither-cli: --shutdown needs --connect\n");
+		return exitUsage;
+	}
+	//The daemon gets its images from clients
+	if (options.inputs.empty() && options.serveSocket == nullptr && !options.shutdownDaemon)
+	{
+		fprintf(stderr, "dither-cli: no input images\n");
+		PrintUsage(stderr);
+		return exitUsage;
+	}
+	return exitSuccess;
+}
+
+static void OnStopSignal(int)
+{
+	StopDaemon();
+}
+
+//Runs the daemon until a client or a signal stops it
+static int Serve(const Options &options)
+{
+	DaemonOptions daemon;
+	daemon.workers = options.jobs;
+	daemon.settings = options.settings;
+	daemon.stripRows = options.stripRows;
+	daemon.mapFiles = options.mapFiles;
+	daemon.raw = options.raw;
+	signal(SIGINT, OnStopSignal);
+	signal(SIGTERM, OnStopSignal);
+
+	std::string error;
+	if (!RunDaemon(options.serveSocket, daemon, error))
+	{
+		fprintf(stderr, "dither-cli: %s\n", error.c_str());
+		return exitDaemon;
+	}
+	if (options.stats && Profiler::IsEnabled())
+		PrintStageStats();
+	return exitSuccess;
+}
+
+//Paths are sent absolute, the daemon runs in its own directory
+static std::string GetAbsolutePath(const std::string &path)
+{
+	char directory[4096];
+	if ((!path.empty() && path[0] == '/') || getcwd(directory, sizeof(directory)) == nullptr)
+		return path;
+	return std::string(directory) + "/" + path;
+}
+
+//Fields of a request with the settings of the options
+static std::string GetDaemonSettings(const Options &options)
+{
+	static const char *filters[] = {"box", "bilinear", "lanczos"};
+	std::string settings = "\talgorithm=" + std::to_string(options.algorithm) + "\tcolored=" + (options.colored ? "1" : "0") +
+						   "\tseed=" + std::to_string(options.settings.seed) + "\tserpentine=" + (options.settings.serpentine ? "1" : "0") +
+						   "\tlinear=" + (options.settings.linear ? "1" : "0");
+	//The daemon uses its own thread count unless one is given
+	if (options.settings.threadCount > 0)
+		settings += "\tthreads=" + std::to_string(options.settings.threadCount);
+	if (options.paletteText != nullptr)
+		settings += "\tpalette=" + std::string(options.paletteText);
+	if (options.resizeWidth > 0 || options.resizeHeight > 0)
+		settings += "\tresize=" + std::to_string(options.resizeWidth) + "x" + std::to_string(options.resizeHeight) + "\tfilter=" + filters[(int)options.filter];
+	return settings;
+}
+
+//Inputs with the same name in different directories would overwrite the results of each other in the output directory
+static bool CheckOutputPaths(const std::vector<std::string> &outputs)
+{
+	std::set<std::string> paths;
+	for (const std::string &output : outputs)
+	{
+		if (!paths.insert(output).second)
+		{
+			fprintf(stderr, "dither-cli: more than one result would be saved to %s\n", output.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+//Sends the images to a daemon and prints its replies like a batch
+static int Connect(const Options &options)
+{
+	DaemonClient client;
+	if (!client.Connect(options.connectSocket))
+	{
+		fprintf(stderr, "dither-cli: can't connect to a daemon on %s\n", options.connectSocket);
+		return exitDaemon;
+	}
+
+	ManifestVariant variant;
+	variant.suffix = options.suffix;
+	variant.format = options.outputFormat != nullptr ? options.outputFormat : "";
+	std::vector<std::string> outputs;
+	for (const char *input : options.inputs)
+		outputs.push_back(GetOutputPath(input, options, variant));
+	if (!options.inputs.empty() && !CheckOutputPaths(outputs))
+		return exitUsage;
+	std::string settings = GetDaemonSettings(options);
+
+	//Requests are sent while the replies are read, so neither side waits for the other one
+	auto start = std::chrono::steady_clock::now();
+	std::thread sender([&]
+	{
+		for (size_t i = 0; i < options.inputs.size(); i++)
+		{
+			if (!client.Send("dither\t" + std::to_string(i) + "\t" + GetAbsolutePath(options.inputs[i]) + "\t" + GetAbsolutePath(outputs[i]) + settings))
+				return;
+		}
+		if (options.shutdownDaemon)
+			client.Send("shutdown");
+	});
+
+	int count = (int)options.inputs.size();
+	int replies = 0;
+	int failed = 0;
+	double megapixels = 0.0;
+	double daemonSeconds = 0.0;
+	std::string reply;
+	while (replies < count && client.Receive(reply))
+	{
+		std::vector<std::string> fields = SplitDaemonFields(reply);
+		unsigned long index;
+		if (fields.size() < 3 || !ParseNumber(fields[1].c_str(), index) || index >= (unsigned long)count)
+			continue;
+		replies++;
+		int width = 0, height = 0;
+		long long microseconds = 0;
+		if (fields[0] == "ok" && fields.size() >= 4 && sscanf(fields[2].c_str(), "%dx%d", &width, &height) == 2)
+		{
+			microseconds = atoll(fields[3].c_str());
+			megapixels += (double)width * height / 1e6;
+			daemonSeconds += microseconds / 1e6;
+			if (!options.quiet)
+			{
+				printf("OK    %s -> %s (%dx%d, %lld us)\n", options.inputs[index], outputs[index].c_str(), width, height, microseconds);
+				fflush(stdout);
+			}
+		}
+		else
+		{
+			failed++;
+			fprintf(stderr, "FAIL  %s -> %s: %s\n", options.inputs[index], outputs[index].c_str(), fields[2].c_str());
+		}
+	}
+	sender.join();
+	if (replies < count)
+	{
+		fprintf(stderr, "dither-cli: the daemon closed the connection before %d replies\n", count - replies);
+		failed += count - replies;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!options.quiet && count > 0)
+	{
+		printf("%d of %d images dithered by the daemon in %.2f s (%.1f files/s, %.1f MP/s, %.0f us per image in the daemon)\n", count - failed, count,
+			   seconds, (count - failed) / seconds, megapixels / seconds, replies > failed ? daemonSeconds * 1e6 / (replies - failed) : 0.0);
+	}
+	return failed == 0 ? exitSuccess : exitFailedFiles;
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	int status = ParseArguments(argc, argv, options);
+	if (status != exitSuccess)
+		return status;
+	if (options.serveSocket != nullptr)
+		return Serve(options);
+	if (options.connectSocket != nullptr)
+		return Connect(options);
+
+	//The options give one variant, or the defaults of the variants of a manifest
+	ManifestVariant defaults;
+	defaults.variant.algorithm = options.algorithm;
+	defaults.variant.colored = options.colored;
+	defaults.variant.palette = options.palette;
+	defaults.variant.resizeWidth = options.resizeWidth;
+	defaults.variant.resizeHeight = options.resizeHeight;
+	defaults.variant.filter = options.filter;
+	defaults.suffix = options.suffix;
+	defaults.format = options.outputFormat != nullptr ? options.outputFormat : "";
+	std::vector<ManifestVariant> variants = {defaults};
+	std::string error;
+	if (options.manifestPath != nullptr && !LoadBatchManifest(options.manifestPath, defaults, variants, error))
+	{
+		fprintf(stderr, "dither-cli: %s: %s\n", options.manifestPath, error.c_str());
+		return exitUsage;
+	}
+	//The temporal filter compares the frames with the results of the frames before them, every variant of the manifest needs that
+	for (const ManifestVariant &variant : variants)
+	{
+		if (options.temporalThreshold >= 0 && (variant.variant.resizeWidth > 0 || variant.variant.resizeHeight > 0 || variant.variant.palette.extractCount > 0))
+		{
+			fprintf(stderr, "dither-cli: --temporal needs frames that aren't resized and a palette that isn't extracted\n");
+			return exitUsage;
+		}
+	}
+
+	//Sequences are replaced by their frames, every input is a sequence of its own
+	std::vector<BatchJob> jobs;
+	for (int sequence = 0; sequence < (int)options.inputs.size(); sequence++)
+	{
+		std::vector<std::string> frames = {options.inputs[sequence]};
+		if (options.sequence && !GetSequenceFrames(options.inputs[sequence], frames, error))
+		{
+			fprintf(stderr, "dither-cli: %s\n", error.c_str());
+			return exitUsage;
+		}
+		for (int frame = 0; frame < (int)frames.size(); frame++)
+		{
+			BatchJob job = {frames[frame], {}, sequence, frame};
+			for (const ManifestVariant &variant : variants)
+				job.outputs.push_back(GetOutputPath(frames[frame].c_str(), options, variant));
+			jobs.push_back(job);
+		}
+	}
+
+	std::vector<std::string> outputs;
+	for (const BatchJob &job : jobs)
+		outputs.insert(outputs.end(), job.outputs.begin(), job.outputs.end());
+	if (!CheckOutputPaths(outputs))
+		return exitUsage;
+
+	BatchOptions batchOptions;
+	for (const ManifestVariant &variant : variants)
+		batchOptions.variants.push_back(variant.variant);
+	batchOptions.settings = options.settings;
+	batchOptions.workers = options.jobs;
+	batchOptions.queueDepth = options.queueDepth;
+	batchOptions.stripRows = options.stripRows;
+	batchOptions.mapFiles = options.mapFiles;
+	batchOptions.raw = options.raw;
+	batchOptions.temporal = options.temporalThreshold >= 0;
+	batchOptions.temporalThreshold = options.temporalThreshold;
+
+	if (options.tracePath != nullptr)
+		Profiler::StartTrace();
+	BatchStats stats = RunBatch(jobs, batchOptions, [&](const BatchFileStatus &file)
+	{
+		if (file.error != nullptr)
+			fprintf(stderr, "FAIL  %s -> %s: %s\n", file.job->input.c_str(), file.job->outputs[file.variant].c_str(), file.error);
+		else if (!options.quiet)
+		{
+			printf("OK    %s -> %s (%dx%d)\n", file.job->input.c_str(), file.job->outputs[file.variant].c_str(), file.width, file.height);
+			//Keeps the status lines in order with the errors on stderr
+			fflush(stdout);
+		}
+	});
+
+	if (!options.quiet)
+	{
+		std::string method = variants.size() == 1 ? Kernels::GetAlgorithms()[variants[0].variant.algorithm].name : std::to_string(variants.size()) + " variants";
+		const char *unit = options.sequence ? "frames" : "images";
+		printf("%d of %d %s dithered with %s in %.2f s (%.1f %s/s, %.1f MP/s)\n", stats.files - stats.failed, stats.files, unit, method.c_str(),
+			   stats.seconds, stats.FilesPerSecond(), options.sequence ? "frames" : "files", stats.MegapixelsPerSecond());
+	}
+	if (options.stats && Profiler::IsEnabled())
+		PrintStageStats();
+	if (options.tracePath != nullptr && Profiler::IsEnabled() && !Profiler::SaveTrace(options.tracePath))
+		fprintf(stderr, "dither-cli: can't save the trace to %s\n", options.tracePath);
+	return stats.failed == 0 ? exitSuccess : exitFailedFiles;
+}
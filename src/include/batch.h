@@ -0,0 +1,124 @@
+#pragma once
+
+#include "imageFile.h"
+#include "kernels.h"
+#include "palette.h"
+#include "resample.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Batch processing of image files as a pipeline: files are decoded, dithered and encoded at the same time
+namespace Dithering
+{
+	// Result made from every input: the algorithm and its options, one decoded input can give several results
+	struct BatchVariant
+	{
+		int algorithm = 0;
+		bool colored = false;	// When false the images are saved as grayscale (like the application does)
+		PaletteSpec palette;	// Colors to dither to, unset dithers every chanel to black or white
+		int resizeWidth = 0;	// Size of the results, the images are resized as they are dithered (a zero keeps the aspect ratio, two zeros the size)
+		int resizeHeight = 0;
+		ResampleFilter filter = ResampleFilter::Lanczos;
+	};
+
+	// One input file of the batch, outputs has the path of the result of every variant
+	struct BatchJob
+	{
+		std::string input;
+		std::vector<std::string> outputs;
+		// Sequence of the frame and its position in it, for BatchOptions::temporal (frames are numbered from 0 in every sequence)
+		int sequence = 0;
+		int frame = 0;
+	};
+
+	// Size of raw input files, they are only pixels without a header
+	struct RawLayout
+	{
+		int width = 0;
+		int height = 0;
+		Format format = Format::Grayscale;
+	};
+
+	struct BatchOptions
+	{
+		std::vector<BatchVariant> variants;	// Results of every input, an input is decoded once and its variants are dithered from it in parallel
+		Settings settings;		// Settings of the kernels, threadCount is the thread count for dithering one image
+		int workers = 0;		// Threads of every stage (0 uses the number of cores)
+		int queueDepth = 0;		// Decoded and dithered images that can wait for the next stage (0 uses workers)
+		int stripRows = 0;		// When set netpbm files (pgm, ppm or pam to pbm, pgm, ppm or pam) are streamed in strips of rows instead of decoded whole
+		bool mapFiles = false;	// Netpbm inputs are mapped to memory and dithered straight into a mapped output when it is a pgm, ppm or pam
+		RawLayout raw;			// Size of .raw inputs, which are always mapped
+		// Jobs are the frames of a sequence in order: error diffusion keeps the result of the previous frame for the pixels whose source didn't
+		// change by more than temporalThreshold in any chanel and diffuses the difference from it, so still parts don't flicker (ordered, blue
+		// noise and random dithering are stable by themselves). Frames are decoded and encoded in parallel, error diffusion dithers the frames
+		// of a variant in frame order on the thread pool, it needs frames of one size that aren't resized, streamed or mapped. Every sequence
+		// (BatchJob::sequence) is filtered on its own
+		bool temporal = false;
+		int temporalThreshold = 0;
+	};
+
+	// Result of one variant of a file, error is nullptr when the result was saved to job->outputs[variant]
+	struct BatchFileStatus
+	{
+		const BatchJob *job;
+		int variant;
+		const char *error;
+		int width;
+		int height;
+	};
+
+	struct BatchStats
+	{
+		int files = 0;			// Results, every variant of every input
+		int failed = 0;
+		double seconds = 0.0;
+		double megapixels = 0.0; // Pixels of the files that were saved
+
+		double FilesPerSecond() const { return seconds > 0.0 ? (files - failed) / seconds : 0.0; }
+		double MegapixelsPerSecond() const { return seconds > 0.0 ? megapixels / seconds : 0.0; }
+	};
+
+	// Variant of a batch manifest and the name of its results
+	struct ManifestVariant
+	{
+		BatchVariant variant;
+		std::string suffix;		// Added to the name of the input
+		std::string format;		// Extension of the results without the dot, empty keeps the format of the input
+	};
+
+	// Reads a batch manifest, a text file with a variant on every line made of key=value pairs (# starts a comment):
+	// algorithm (name or number), colored (0 or 1), palette, resize (WxH), filter, format and suffix
+	// Keys that a line doesn't have are taken from defaults, lines without a suffix add their number to the suffix of defaults when there are several
+	// Returns false with a message in error when a line is invalid or two variants would write the same files
+	bool LoadBatchManifest(const char *path, const ManifestVariant &defaults, std::vector<ManifestVariant> &variants, std::string &error);
+	// Whether a text file starts with a key=value pair (batch configurations of the application start with numbers)
+	bool IsBatchManifest(const char *path);
+
+	// Frames of an image sequence: the images of a directory sorted by name (frame2 before frame10), or the files of a numbered pattern like
+	// frame_%04d.png from 0 or 1 up to the first missing number. Returns false with a message in error when there are no frames
+	bool GetSequenceFrames(const char *path, std::vector<std::string> &frames, std::string &error);
+
+	// Sets one key of a manifest line, returns false when the key or the value is invalid
+	bool SetManifestValue(ManifestVariant &variant, const std::string &key, const std::string &value);
+
+	// Processes all jobs and waits for them, onFile is called once for every result as it finishes (one call at a time, in any order)
+	// At most workers * 3 + queueDepth * 2 results are in memory at the same time (and the inputs they are made from), a streamed file takes
+	// only a few strips and a mapped file none (its pages are in the page cache)
+	BatchStats RunBatch(const std::vector<BatchJob> &jobs, const BatchOptions &options, const std::function<void(const BatchFileStatus &)> &onFile);
+
+	// Images of a thread that processes jobs one after another, they keep their memory so later images up to the same size allocate nothing
+	struct BatchArena
+	{
+		ImageFile input;
+		ImageFile result;
+	};
+
+	// Palettes of the variants that are the same for every image (extracted palettes are made for every image)
+	std::vector<Palette> MakeBatchPalettes(const BatchOptions &options);
+	// Processes one job on the calling thread without starting any: decodes (maps or streams) the input once, dithers and saves every variant
+	// onFile is called for every variant, palettes are from MakeBatchPalettes
+	void ProcessBatchJob(const BatchJob &job, const BatchOptions &options, const std::vector<Palette> &palettes, BatchArena &arena,
+						 const std::function<void(const BatchFileStatus &)> &onFile);
+}
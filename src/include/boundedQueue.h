@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace Dithering
+{
+	// Queue between two pipeline stages, Push blocks while the queue is full so a fast stage can't run ahead and use all memory
+	template<typename T>
+	class BoundedQueue
+	{
+	public:
+		explicit BoundedQueue(int capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+		// Returns false when the queue was closed, the item is dropped then
+		bool Push(T item)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			notFull.wait(lock, [&] { return closed || (int)items.size() < capacity; });
+			if (closed)
+				return false;
+			items.push_back(std::move(item));
+			notEmpty.notify_one();
+			return true;
+		}
+
+		// Waits for an item, returns false when the queue is closed and empty
+		bool Pop(T &item)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			notEmpty.wait(lock, [&] { return closed || !items.empty(); });
+			if (items.empty())
+				return false;
+			item = std::move(items.front());
+			items.pop_front();
+			notFull.notify_one();
+			return true;
+		}
+
+		// No more items will be pushed, Pop returns the remaining ones and then fails
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			notEmpty.notify_all();
+			notFull.notify_all();
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable notEmpty;
+		std::condition_variable notFull;
+		std::deque<T> items;
+		int capacity;
+		bool closed = false;
+	};
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+namespace Dithering
+{
+	// Instruction sets the vectorized kernels can use
+	enum class Isa
+	{
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	// Best instruction set supported by this CPU, detected once with cpuid
+	// (DITHER_ISA=scalar/sse2/avx2 can force a lower one)
+	Isa GetIsa();
+	// Printable name of the instruction set
+	const char *GetIsaName(Isa isa);
+}
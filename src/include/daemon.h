@@ -0,0 +1,63 @@
+#pragma once
+
+#include "batch.h"
+
+#include <string>
+
+// Local daemon that keeps the thread pool, the threshold tables and the buffers of its workers warm, so dithering a small image
+// costs a message on a Unix domain socket instead of starting a process
+//
+// Requests and replies are lines of fields separated by tabs, a connection can send many requests without waiting for the replies:
+//   dither <id> <input> <output> [key=value...]    Dithers a file (decoded, mapped or streamed like a batch) and saves it to output
+//   memory <id> <name> <width>x<height>x<chanels> [key=value...]
+//                                                  Dithers a POSIX shared memory object (shm_open) with tightly packed rows in place
+//   ping <id>                                      Answers right away
+//   shutdown                                       Stops the daemon after the jobs it has
+// The keys are the ones of batch manifests (algorithm, colored, palette, resize and filter) and seed, serpentine, linear and threads
+// Every request with an id gets one reply, in the order the jobs finish:
+//   ok <id> <width>x<height> <microseconds>        The job took microseconds from its request to its end
+//   error <id> <message>
+// Replies are sent by a thread of the connection, a client that lets 1 MB of replies wait or doesn't read for 10 seconds is dropped
+// The socket is made with mode 0600: a client can write any file the daemon can and stop it, so only its user can connect
+namespace Dithering
+{
+	struct DaemonOptions
+	{
+		int workers = 0;		// Jobs dithered at the same time (0 uses the number of cores)
+		Settings settings;		// Defaults of the jobs, threadCount is the thread count for dithering one image
+		int stripRows = 0;		// Like BatchOptions, for the files of dither requests
+		bool mapFiles = false;
+		RawLayout raw;
+	};
+
+	// Listens on socketPath and runs the jobs of every client until a shutdown request or StopDaemon
+	// A socket file left by a daemon that is gone is replaced, returns false with a message in error when the socket can't be opened
+	bool RunDaemon(const char *socketPath, const DaemonOptions &options, std::string &error);
+	// Makes RunDaemon return after the jobs it has, it can be called from a signal handler
+	void StopDaemon();
+
+	// Connection to a daemon, sends requests and reads the replies as lines (without the newline)
+	class DaemonClient
+	{
+	public:
+		DaemonClient() = default;
+		~DaemonClient();
+
+		DaemonClient(const DaemonClient &) = delete;
+		DaemonClient &operator=(const DaemonClient &) = delete;
+
+		bool Connect(const char *socketPath);
+		// Sending and receiving can be done by different threads, so the replies are read while requests are still sent
+		bool Send(const std::string &request);
+		// Waits for the next reply, returns false when the daemon closed the connection
+		bool Receive(std::string &reply);
+		void Close();
+
+	private:
+		int socket = -1;
+		std::string received;
+	};
+
+	// Splits a request or a reply into its fields
+	std::vector<std::string> SplitDaemonFields(const std::string &line);
+}
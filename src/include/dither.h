@@ -0,0 +1,69 @@
+#pragma once
+
+#include "kernels.h"
+#include "resample.h"
+
+#include <functional>
+#include <vector>
+
+// Public API of the dither library, works on raw pixel buffers and needs no window, GPU or raylib
+namespace Dithering
+{
+	// Index of an algorithm in Kernels::GetAlgorithms() from its name (case insensitive) or its index, -1 when there is none
+	int FindAlgorithm(const char *name);
+
+	// Writes the luminance of the source pixels to gray, a grayscale buffer of the same size (same conversion as raylib, or the luminance of
+	// linear light when linear is set like Settings::linear)
+	void ConvertToGrayscale(const PixelBuffer &source, PixelBuffer &gray, bool linear = false);
+
+	// Dithers the pixels in place, rows are stride bytes apart
+	// When colored is false the color chanels are converted to grayscale first (alpha is kept)
+	// Returns false when the arguments are invalid
+	bool Dither(byte *data, int width, int height, int stride, Format format, int algorithm, bool colored, const Settings &settings);
+
+	// Dithers source into destination, a buffer of the same size that is either grayscale (gets the luminance of any format) or in the format of source
+	// The kernel loads every row right before dithering it, so the source is read once and left unchanged (it can be a read only mapping)
+	bool DitherInto(const PixelBuffer &source, PixelBuffer &destination, int algorithm, const Settings &settings);
+
+	// Resizes source to the size of destination and dithers it in the same pass, the resized image is never stored
+	// The kernel resamples every row right before dithering it, destination is grayscale or in the format of source (like DitherInto)
+	bool DitherResized(const PixelBuffer &source, PixelBuffer &destination, ResampleFilter filter, int algorithm, const Settings &settings);
+
+	// Dithers an image that comes in strips of rows from the top, so images that don't fit in memory can be streamed
+	// Error diffusion carries its error rows from one strip to the next, the result is the same as dithering the whole image
+	class StreamDitherer
+	{
+	public:
+		// format is the format of the strips that are dithered (the destination format for DitherStripInto)
+		StreamDitherer(int width, Format format, int algorithm, const Settings &settings);
+
+		// Dithers the next rows in place, their y is set to the row of the image where they start
+		void DitherStrip(PixelBuffer &strip);
+		// Dithers the next rows of source into destination (like DitherInto)
+		void DitherStripInto(PixelBuffer &source, PixelBuffer &destination);
+
+		int GetNextRow() const { return nextRow; }
+
+	private:
+		const Kernels::Algorithm &algorithm;
+		Settings settings;
+		std::unique_ptr<Kernels::DiffusionStream> diffusion;
+		int nextRow = 0;
+	};
+
+	// Rectangle of an image in pixels
+	struct Tile
+	{
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	// Splits an image into tiles of tileSize pixels, the tiles that overlap focus come first and nearer tiles to its center come sooner
+	std::vector<Tile> GetTiles(int width, int height, int tileSize, const Tile &focus);
+
+	// Dithers the tiles in the given order with a point-wise algorithm (Kernels::Algorithm::pointWise), the result is the same as dithering the whole image
+	// onTile is called from the dithering threads as soon as a tile is finished, returns false when the algorithm isn't point-wise
+	bool DitherTiles(PixelBuffer &buffer, int algorithm, const std::vector<Tile> &tiles, const Settings &settings, const std::function<void(const Tile &)> &onTile);
+}
@@ -2,6 +2,8 @@
 
 #include <raylib.h>
 
+#include "kernels.h"
+
 // All implemented dithering algorithms
 namespace Dithering
 {
@@ -17,4 +19,31 @@ namespace Dithering
 	void Ordered16x16(Image &image, bool colored);
 	// Error diffusion dithering using Floyd-Steinberg algorithm
 	void FloydSteinberg(Image &image, bool colored);
+	// Error diffusion dithering using Jarvis, Judice and Ninke algorithm
+	void JarvisJudiceNinke(Image &image, bool colored);
+	// Error diffusion dithering using Stucki algorithm
+	void Stucki(Image &image, bool colored);
+	// Error diffusion dithering using Burkes algorithm
+	void Burkes(Image &image, bool colored);
+	// Error diffusion dithering using Sierra algorithm (three rows)
+	void Sierra(Image &image, bool colored);
+	// Error diffusion dithering using two-row Sierra algorithm
+	void TwoRowSierra(Image &image, bool colored);
+	// Error diffusion dithering using Sierra Lite algorithm
+	void SierraLite(Image &image, bool colored);
+	// Error diffusion dithering using Atkinson algorithm
+	void Atkinson(Image &image, bool colored);
+	// Orderd dithering using a 32x32 Bayer matrix
+	void Ordered32x32(Image &image, bool colored);
+	// Orderd dithering using a 64x64 Bayer matrix
+	void Ordered64x64(Image &image, bool colored);
+	// Orderd dithering using a blue noise mask (void-and-cluster)
+	void BlueNoise(Image &image, bool colored);
+
+	// Converts the image to a format the kernels support (grayscale when colored is false, the luminance of linear light when linear is set)
+	// and returns a view of its pixels
+	PixelBuffer GetPixelBuffer(Image &image, bool colored, bool linear = false);
+
+	// Runs the algorithm with the given index (same order as above) with its own settings, safe to call from any thread
+	void Dither(Image &image, int algorithm, bool colored, const Settings &settings);
 }
\ No newline at end of file
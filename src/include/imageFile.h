@@ -0,0 +1,33 @@
+#pragma once
+
+#include "kernels.h"
+#include "packedImage.h"
+
+#include <vector>
+
+// Image file loading and saving without raylib (png, bmp, tga, jpg, the other formats of stb_image and pam)
+namespace Dithering
+{
+	// Decoded image that owns its pixels, rows are tightly packed
+	struct ImageFile
+	{
+		std::vector<byte> pixels;
+		int width = 0;
+		int height = 0;
+		Format format = Format::R8G8B8A8;
+
+		PixelBuffer GetBuffer() { return {pixels.data(), width, height, width * (int)format, format}; }
+	};
+
+	// Loads an image keeping the chanels of the file (gray with alpha is loaded as RGBA)
+	bool LoadImageFile(const char *path, ImageFile &image);
+	// Loads an image converted to the requested format
+	bool LoadImageFile(const char *path, Format format, ImageFile &image);
+	// Saves the pixels in the format given by the extension of the path (.png, .bmp, .tga, .jpg, .pbm, .pgm, .ppm, .pam or .raw)
+	// Images with at most 256 colors are packed first, so png gets 1, 2, 4 or 8 bits per pixel (.pbm and .raw need a packed image)
+	bool SaveImageFile(const char *path, const PixelBuffer &buffer);
+	// Saves a packed image: .png (grayscale or paletted), .pbm (black and white only), .pgm, .ppm, .pam or .raw (the packed rows without a header)
+	bool SavePackedImageFile(const char *path, const PackedImage &image);
+	// Whether SaveImageFile can write files with the extension of the path
+	bool IsSupportedOutput(const char *path);
+}
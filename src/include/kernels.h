@@ -0,0 +1,192 @@
+#pragma once
+
+#include <string.h>
+#include <atomic>
+#include <memory>
+
+// Dithering kernels that work directly on raw pixel data (no raylib dependency)
+namespace Dithering
+{
+	// byte type declaration
+	using byte = unsigned char;
+
+	// Pixel formats supported by the kernels (the value is the number of bytes per pixel)
+	enum class Format
+	{
+		Grayscale = 1,
+		R8G8B8 = 3,
+		R8G8B8A8 = 4
+	};
+
+	// View of raw pixel data, rows are stride bytes apart
+	struct PixelBuffer
+	{
+		byte *data;
+		int width;
+		int height;
+		int stride;
+		Format format;
+		// Position of the first pixel in the whole image, point-wise kernels give a part of an image the same pattern as the whole image
+		int x = 0;
+		int y = 0;
+	};
+
+	class Palette;
+	class Resampler;
+
+	// Progress of a running kernel, shared with the thread that waits for it
+	struct Progress
+	{
+		std::atomic<int> rows{0}; // Rows that are finished
+		std::atomic<bool> cancelled{false}; // Set to stop the kernel early, the image is left partially dithered
+	};
+
+	// Result of the previous frame of a sequence for error diffusion: the pixels whose keep byte is set take their previous value as their
+	// result and diffuse the difference from it, so still parts of the image don't flicker and the error around them stays right
+	struct TemporalFrame
+	{
+		const byte *keep; // One byte per pixel, tightly packed rows of the whole image
+		const byte *previous; // Previous result, tightly packed rows of the whole image in the format of the buffer
+	};
+
+	// Settings passed to every kernel
+	struct Settings
+	{
+		int threadCount = 0; // 0 uses DITHER_THREADS or the number of cores
+		bool wavefront = true; // Error diffusion runs rows in parallel as a skewed pipeline (same output as one thread)
+		bool serpentine = false; // Error diffusion goes right to left on odd rows (always on one thread)
+		unsigned int seed = 0; // Seed of the random dithering, the same seed always gives the same image
+		Progress *progress = nullptr; // Optional progress reporting and cancellation
+		const Palette *palette = nullptr; // When set pixels get the nearest palette color instead of 1 bit per chanel (see palette.h)
+		// When set the buffer is filled from these pixels (same size) one row at a time as it is dithered, so the image is read once and
+		// stays as it was: grayscale buffers get the luminance of any format, other buffers copy the same format (see DitherInto in dither.h)
+		const PixelBuffer *source = nullptr;
+		// When set the buffer is filled with rows of a resized image instead, x and y of the buffer are positions in it (see resample.h)
+		const Resampler *resampler = nullptr;
+		// Thresholds and errors are in linear light instead of on the sRGB bytes, so midtones keep their brightness, and gray gets the
+		// luminance of linear light instead of the luma of raylib (see linearLight.h)
+		bool linear = false;
+		// When set error diffusion keeps pixels of the previous frame, point-wise kernels give the same result for the same pixels anyway
+		const TemporalFrame *temporal = nullptr;
+	};
+
+	// Settings of the application, changed by the GUI options and the batch configuration
+	Settings &GetSettings();
+
+	// Whether the kernel should stop, checked between bands of rows
+	inline bool IsCancelled(const Settings &settings)
+	{
+		return settings.progress != nullptr && settings.progress->cancelled.load(std::memory_order_relaxed);
+	}
+
+	// Writes the luminance of width pixels to gray (the grayscale conversion of raylib, or the luminance of linear light when linear is set),
+	// gray pixels are copied
+	void ConvertRowToGrayscale(const byte *pixels, Format format, byte *gray, int width, bool linear = false);
+
+	// Fills row y of the buffer from Settings::resampler
+	void LoadResampledRow(const PixelBuffer &buffer, int y, const Settings &settings);
+
+	// Fills row y of the buffer from Settings::source or Settings::resampler when one is set (x and y of both buffers are positions in the same image)
+	inline void LoadSourceRow(const PixelBuffer &buffer, int y, const Settings &settings)
+	{
+		if (settings.resampler != nullptr)
+		{
+			LoadResampledRow(buffer, y, settings);
+			return;
+		}
+		const PixelBuffer *source = settings.source;
+		if (source == nullptr)
+			return;
+		const byte *row = source->data + (long long)(buffer.y - source->y + y) * source->stride + (buffer.x - source->x) * (int)source->format;
+		byte *destination = buffer.data + (long long)y * buffer.stride;
+		if (buffer.format == Format::Grayscale)
+			ConvertRowToGrayscale(row, source->format, destination, buffer.width, settings.linear);
+		else
+			memcpy(destination, row, (size_t)buffer.width * (int)buffer.format);
+	}
+
+	// Reports rows that are finished
+	inline void AddProgress(const Settings &settings, int rows)
+	{
+		if (settings.progress != nullptr)
+			settings.progress->rows.fetch_add(rows, std::memory_order_relaxed);
+	}
+
+	// Compile time information about a pixel format
+	template<Format F>
+	struct FormatTraits
+	{
+		static constexpr int bytesPerPixel = (int)F;
+		// Alpha is never dithered, only the color chanels are
+		static constexpr int colorChannels = F == Format::Grayscale ? 1 : 3;
+	};
+
+	// Kernels are specialized for every format, the format is checked once per image
+	namespace Kernels
+	{
+		// Calls Kernel<F>::Run with the buffer format as the template argument, so the per pixel code has no format checks
+		template<template<Format> class Kernel, typename... Args>
+		void Dispatch(PixelBuffer &buffer, Args... args)
+		{
+			switch (buffer.format)
+			{
+				case Format::Grayscale:
+					Kernel<Format::Grayscale>::Run(buffer, args...);
+					break;
+				case Format::R8G8B8:
+					Kernel<Format::R8G8B8>::Run(buffer, args...);
+					break;
+				case Format::R8G8B8A8:
+					Kernel<Format::R8G8B8A8>::Run(buffer, args...);
+					break;
+			}
+		}
+
+		// Random dithering with thresholds hashed from Settings::seed and the pixel position (point-wise kernels process bands of rows in parallel)
+		void Random(PixelBuffer &buffer, const Settings &settings);
+		// Ordered dithering, the threshold for a pixel is pattern[(x % patternSize) * patternSize + y % patternSize]
+		void Ordered(PixelBuffer &buffer, const Settings &settings, const byte *pattern, int patternSize);
+		// Ordered dithering using Bayer matrices (generated at compile time)
+		void Ordered2x2(PixelBuffer &buffer, const Settings &settings);
+		void Ordered4x4(PixelBuffer &buffer, const Settings &settings);
+		void Ordered8x8(PixelBuffer &buffer, const Settings &settings);
+		void Ordered16x16(PixelBuffer &buffer, const Settings &settings);
+		void Ordered32x32(PixelBuffer &buffer, const Settings &settings);
+		void Ordered64x64(PixelBuffer &buffer, const Settings &settings);
+		// Ordered dithering using a 64x64 void-and-cluster blue noise mask (generated at build time)
+		void BlueNoise(PixelBuffer &buffer, const Settings &settings);
+		// Error diffusion kernels (rows are pipelined across threads when Settings::wavefront is set)
+		void FloydSteinberg(PixelBuffer &buffer, const Settings &settings);
+		void JarvisJudiceNinke(PixelBuffer &buffer, const Settings &settings);
+		void Stucki(PixelBuffer &buffer, const Settings &settings);
+		void Burkes(PixelBuffer &buffer, const Settings &settings);
+		void Sierra(PixelBuffer &buffer, const Settings &settings);
+		void TwoRowSierra(PixelBuffer &buffer, const Settings &settings);
+		void SierraLite(PixelBuffer &buffer, const Settings &settings);
+		void Atkinson(PixelBuffer &buffer, const Settings &settings);
+
+		// Kernel of an algorithm with its display name
+		struct Algorithm
+		{
+			const char *name;
+			void (*kernel)(PixelBuffer &buffer, const Settings &settings);
+			bool pointWise; // Every pixel depends only on itself (random and ordered), so any part of the image can be dithered on its own
+		};
+
+		// All algorithms in the same order as in the application
+		const Algorithm *GetAlgorithms();
+		int GetAlgorithmCount();
+
+		// Error diffusion state that is kept between strips of rows of one image, so the strips give the same result as the whole image
+		class DiffusionStream
+		{
+		public:
+			virtual ~DiffusionStream() = default;
+			// Dithers the rows of strip, strip.y is its first row in the image and the strips have to come in order from the top
+			virtual void Run(PixelBuffer &strip, const Settings &settings) = 0;
+		};
+
+		// Error diffusion state of an algorithm for strips of width pixels, nullptr for point-wise algorithms
+		std::unique_ptr<DiffusionStream> CreateDiffusionStream(const Algorithm &algorithm, int width, Format format, const Settings &settings);
+	}
+}
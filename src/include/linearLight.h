@@ -0,0 +1,32 @@
+#pragma once
+
+#include "kernels.h"
+
+#include <stdint.h>
+
+// sRGB transfer function as lookup tables, so the kernels can threshold and diffuse errors in linear light without a powf per pixel
+namespace Dithering
+{
+	// Linear light is kept in 12 bits, so the darkest sRGB levels (which are less than one 8 bit step of linear light) stay apart
+	constexpr int linearBits = 12;
+	constexpr int linearWhite = (1 << linearBits) - 1;
+
+	struct LinearTables
+	{
+		uint16_t toLinear[256];				// sRGB byte to linear light (0 to linearWhite)
+		byte toSrgb[linearWhite + 1];		// Linear light to the nearest sRGB byte
+		// Threshold t of a pattern (the pixel is white when it is above t / 255 of white) as the sRGB byte to compare the encoded pixel with,
+		// so ordered dithering in linear light is the same vectorized compare with other thresholds
+		byte thresholds[256];
+		// Chanels weighted for the luminance of linear light (Rec. 709), in 1 / 65536 of linearWhite
+		uint32_t red[256];
+		uint32_t green[256];
+		uint32_t blue[256];
+	};
+
+	// Tables are computed once, the first time they are used
+	const LinearTables &GetLinearTables();
+
+	// Writes the luminance of linear light of width pixels to gray encoded as sRGB (perceptually right gray levels, unlike the luma of raylib)
+	void ConvertRowToLuminance(const byte *pixels, Format format, byte *gray, int width);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <list>
+
+namespace Dithering
+{
+	// Cache that keeps the most recently used values within a memory budget
+	// Values are released with the evict function when they are dropped, the most recently used value is always kept
+	template<typename Key, typename Value>
+	class LruCache
+	{
+	public:
+		LruCache(size_t budget, std::function<void(Value &)> evict) : budget(budget), evict(std::move(evict)) {}
+		~LruCache() { Clear(); }
+
+		LruCache(const LruCache &) = delete;
+		LruCache &operator=(const LruCache &) = delete;
+
+		// Returns the cached value and marks it as the most recently used one, nullptr when it isn't cached
+		Value *Find(const Key &key)
+		{
+			for (auto entry = entries.begin(); entry != entries.end(); entry++)
+			{
+				if (entry->key == key)
+				{
+					entries.splice(entries.begin(), entries, entry);
+					return &entries.front().value;
+				}
+			}
+			return nullptr;
+		}
+
+		// Adds a value of size bytes as the most recently used one, the least recently used values are evicted to fit the budget
+		// The key must not be cached already
+		Value &Insert(const Key &key, Value value, size_t size)
+		{
+			entries.push_front({key, std::move(value), size});
+			used += size;
+			Trim();
+			return entries.front().value;
+		}
+
+		void SetBudget(size_t bytes)
+		{
+			budget = bytes;
+			Trim();
+		}
+
+		void Clear()
+		{
+			for (Entry &entry : entries)
+				evict(entry.value);
+			entries.clear();
+			used = 0;
+		}
+
+		size_t GetUsed() const { return used; }
+		size_t GetCount() const { return entries.size(); }
+
+	private:
+		struct Entry
+		{
+			Key key;
+			Value value;
+			size_t size;
+		};
+
+		void Trim()
+		{
+			while (used > budget && entries.size() > 1)
+			{
+				used -= entries.back().size;
+				evict(entries.back().value);
+				entries.pop_back();
+			}
+		}
+
+		// Most recently used first, there are only a few entries so they are searched linearly
+		std::list<Entry> entries;
+		size_t used = 0;
+		size_t budget;
+		std::function<void(Value &)> evict;
+	};
+}
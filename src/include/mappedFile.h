@@ -0,0 +1,40 @@
+#pragma once
+
+#include "kernels.h"
+
+#include <stddef.h>
+
+// File mapped to memory, reading and writing it goes straight to the page cache without copies (mmap on POSIX, file mappings on Windows)
+namespace Dithering
+{
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		// Maps an existing file read only
+		bool OpenRead(const char *path);
+		// Creates (or truncates) a file of size bytes and maps it for writing
+		bool Create(const char *path, size_t size);
+
+		byte *GetData() const { return data; }
+		size_t GetSize() const { return size; }
+
+		// Unmaps the file, written pages are left to the system to write back
+		bool Close();
+
+	private:
+		byte *data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		void *file = nullptr;
+		void *mapping = nullptr;
+#else
+		int file = -1;
+#endif
+	};
+}
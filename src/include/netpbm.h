@@ -0,0 +1,86 @@
+#pragma once
+
+#include "kernels.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Netpbm files with 8 bit samples read and written a strip of rows at a time, so an image never has to be in memory as a whole
+namespace Dithering
+{
+	enum class NetpbmType
+	{
+		Bitmap,		// pbm
+		Graymap,	// pgm
+		Pixmap,		// ppm
+		ArbitraryMap // pam
+	};
+
+	class NetpbmReader
+	{
+	public:
+		NetpbmReader() = default;
+		~NetpbmReader();
+
+		NetpbmReader(const NetpbmReader &) = delete;
+		NetpbmReader &operator=(const NetpbmReader &) = delete;
+
+		// Reads the header of a binary pgm (P5), ppm (P6) or pam (P7 with a depth of 1, 3 or 4), the maximum value has to be 255
+		bool Open(const char *path);
+
+		int GetWidth() const { return width; }
+		int GetHeight() const { return height; }
+		Format GetFormat() const { return format; }
+
+		// Reads the next strip.height rows, the strip has the format of the file
+		bool ReadRows(PixelBuffer &strip);
+
+	private:
+		FILE *file = nullptr;
+		int width = 0;
+		int height = 0;
+		Format format = Format::Grayscale;
+	};
+
+	class NetpbmWriter
+	{
+	public:
+		NetpbmWriter() = default;
+		~NetpbmWriter();
+
+		NetpbmWriter(const NetpbmWriter &) = delete;
+		NetpbmWriter &operator=(const NetpbmWriter &) = delete;
+
+		// Writes the header of the file type given by the extension of the path, rows in format are converted to it:
+		// .pbm (1 bit, gray values below 128 are black), .pgm (gray), .ppm (RGB) or .pam (the format of the rows)
+		bool Open(const char *path, int width, int height, Format format);
+
+		// Writes the next strip.height rows
+		bool WriteRows(const PixelBuffer &strip);
+
+		// Flushes and closes the file, false when something couldn't be written
+		bool Close();
+
+	private:
+		FILE *file = nullptr;
+		NetpbmType type = NetpbmType::Pixmap;
+		int width = 0;
+		Format format = Format::Grayscale;
+		bool failed = false;
+		std::vector<byte> row;
+	};
+
+	// Reads the header of a netpbm file in memory (a mapped file) that NetpbmReader can read, offset is the position of the first pixel
+	// Returns false when the header is invalid or the data is too short for the pixels
+	bool ParseNetpbmHeader(const byte *data, size_t size, int &width, int &height, Format &format, size_t &offset);
+	// Header of a file that gets rows of format without any conversion (a pgm for grayscale, a ppm for RGB or a pam for any format)
+	// Empty when the extension of the path is another one or can't hold the format
+	std::string GetNetpbmHeader(const char *path, int width, int height, Format format);
+
+	// Whether the path has an extension that NetpbmReader can read (.pgm, .ppm, .pnm or .pam)
+	bool IsNetpbmInput(const char *path);
+	// Whether the path has an extension that NetpbmWriter can write (.pbm, .pgm, .ppm or .pam)
+	bool IsNetpbmOutput(const char *path);
+}
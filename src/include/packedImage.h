@@ -0,0 +1,37 @@
+#pragma once
+
+#include "kernels.h"
+#include "palette.h"
+
+#include <stddef.h>
+#include <vector>
+
+// Dithered images stored with 1, 2, 4 or 8 bits per pixel, every pixel is an index to a list of colors
+namespace Dithering
+{
+	struct PackedImage
+	{
+		// Rows start at a new byte, the first pixel of a byte is in its highest bits (the order of PNG and PBM)
+		std::vector<byte> data;
+		int width = 0;
+		int height = 0;
+		int bitsPerPixel = 1;
+		int stride = 0;				// Bytes of one row
+		std::vector<Color> colors;	// Colors of the indices, sorted by their RGB value
+		bool gray = false;			// Made from a grayscale image, all colors are gray levels
+
+		int GetIndex(int x, int y) const
+		{
+			int bit = x * bitsPerPixel;
+			int shift = 8 - bitsPerPixel - (bit & 7);
+			return (data[(size_t)y * stride + (bit >> 3)] >> shift) & ((1 << bitsPerPixel) - 1);
+		}
+	};
+
+	// Packs a dithered image with the fewest bits that fit its colors (black and white takes 1 bit, 8 colors take 4 bits)
+	// Returns false when the image has more than 256 colors or a pixel that isn't opaque, the rows are packed on threadCount threads
+	bool PackImage(const PixelBuffer &image, PackedImage &packed, int threadCount = 1);
+
+	// Writes the colors of the packed image to a buffer of the same size (alpha is set to 255)
+	void UnpackImage(const PackedImage &packed, PixelBuffer &destination, int threadCount = 1);
+}
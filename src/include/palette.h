@@ -0,0 +1,101 @@
+#pragma once
+
+#include "kernels.h"
+
+#include <stdint.h>
+#include <vector>
+
+// Dithering to a fixed set of colors instead of 1 bit per chanel
+namespace Dithering
+{
+	struct Color
+	{
+		byte r;
+		byte g;
+		byte b;
+	};
+
+	// Colors to dither to with a precomputed nearest color lookup
+	// The RGB cube is split into 32x32x32 cells and every cell keeps only the colors that can be the nearest one to a point in it,
+	// so a lookup compares a few colors at most (usually one)
+	class Palette
+	{
+	public:
+		Palette() = default;
+		// At most 256 colors, the extra ones are ignored
+		explicit Palette(std::vector<Color> colors);
+
+		const std::vector<Color> &GetColors() const { return colors; }
+		int GetSize() const { return (int)colors.size(); }
+
+		// Index of the color nearest to r, g, b (0 to 255, squared RGB distance)
+		int Nearest(int r, int g, int b) const
+		{
+			int cell = (r >> cellShift) << (cellBits * 2) | (g >> cellShift) << cellBits | (b >> cellShift);
+			const byte *candidate = candidates.data() + cellStart[cell];
+			int count = (int)(cellStart[cell + 1] - cellStart[cell]);
+			if (count == 1)
+				return candidate[0];
+
+			int best = candidate[0];
+			int bestDistance = Distance(colors[best], r, g, b);
+			for (int i = 1; i < count; i++)
+			{
+				int distance = Distance(colors[candidate[i]], r, g, b);
+				if (distance < bestDistance)
+				{
+					best = candidate[i];
+					bestDistance = distance;
+				}
+			}
+			return best;
+		}
+
+		// Gray level of the palette nearest to value (grayscale images use the luminance of the colors)
+		byte NearestGray(int value) const { return grayLevels[value]; }
+
+		// Amplitude of the ordered and random thresholds, the average distance between a color and its nearest neighbour (per chanel)
+		int GetSpread() const { return spread; }
+
+	private:
+		static constexpr int cellBits = 5;
+		static constexpr int cellShift = 8 - cellBits;
+
+		static int Distance(const Color &color, int r, int g, int b)
+		{
+			return (color.r - r) * (color.r - r) + (color.g - g) * (color.g - g) + (color.b - b) * (color.b - b);
+		}
+
+		std::vector<Color> colors;
+		std::vector<uint32_t> cellStart; // Candidates of cell i are candidates[cellStart[i]] to candidates[cellStart[i + 1]]
+		std::vector<byte> candidates;
+		byte grayLevels[256] = {};
+		int spread = 255;
+	};
+
+	enum class PaletteMethod
+	{
+		MedianCut,
+		KMeans // Median cut refined with k-means
+	};
+
+	// Palette given by the user: fixed colors, or the number of colors to extract from every image
+	struct PaletteSpec
+	{
+		std::vector<Color> colors;
+		int extractCount = 0;
+		PaletteMethod method = PaletteMethod::KMeans;
+
+		bool IsSet() const { return !colors.empty() || extractCount > 0; }
+	};
+
+	// Parses a palette: a built in name (bw, gray4, gray16, rgb8, cga, gameboy, pico8), median:N or kmeans:N to extract N colors,
+	// a comma separated list of hex colors (#rrggbb) or a file with one color per line (hex or a GIMP palette)
+	bool ParsePaletteSpec(const char *text, PaletteSpec &spec);
+
+	// Extracts count colors from a subsample of the image
+	std::vector<Color> ExtractPalette(const PixelBuffer &image, int count, PaletteMethod method);
+
+	// Palette of the spec for an image (the image is only read when the colors are extracted)
+	Palette MakePalette(const PaletteSpec &spec, const PixelBuffer &image);
+}
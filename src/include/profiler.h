@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+
+// Timers of the stages of the pipeline (loading, grayscale conversion, dithering, packing, texture upload and saving)
+// They are compiled only with DITHER_PROFILE, without it DITHER_TIME and DITHER_TRACE are empty and cost nothing
+namespace Dithering
+{
+	enum class Stage
+	{
+		Load,
+		Grayscale,	// Only the separate conversion, the kernels convert fused rows while they dither them
+		Dither,
+		Pack,
+		Upload,		// Texture upload of the application
+		Save,
+		Count
+	};
+
+	const char *GetStageName(Stage stage);
+
+	struct StageStats
+	{
+		int count = 0;
+		double seconds = 0.0;		// Summed over the threads, stages of different images can overlap
+		double megapixels = 0.0;
+
+		double MegapixelsPerSecond() const { return seconds > 0.0 ? megapixels / seconds : 0.0; }
+	};
+
+	struct ProfileStats
+	{
+		StageStats stages[(int)Stage::Count];
+
+		const StageStats &operator[](Stage stage) const { return stages[(int)stage]; }
+	};
+
+	namespace Profiler
+	{
+		constexpr bool IsEnabled()
+		{
+#ifdef DITHER_PROFILE
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		using Clock = std::chrono::steady_clock;
+
+		// Adds a finished stage to the totals (and to the trace when it is recorded), called by the timers from any thread
+		void Record(Stage stage, Clock::time_point start, Clock::time_point end, double megapixels);
+		// Adds an event only to the trace, it doesn't count to any stage
+		void RecordTrace(const char *name, Clock::time_point start, Clock::time_point end);
+
+		// Totals of the stages since the last reset
+		ProfileStats GetStats();
+		void Reset();
+
+		// Starts keeping the events of the timers (at most a million, the rest is dropped)
+		void StartTrace();
+		bool IsTracing();
+		// Writes the kept events in the Chrome trace event format (chrome://tracing or ui.perfetto.dev), every thread gets its own track
+		bool SaveTrace(const char *path);
+	}
+
+	// Times its scope as one stage
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Stage stage, double megapixels = 0.0) : stage(stage), megapixels(megapixels), start(Profiler::Clock::now()) {}
+		~ScopedTimer() { Profiler::Record(stage, start, Profiler::Clock::now(), megapixels); }
+
+		ScopedTimer(const ScopedTimer &) = delete;
+		ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+	private:
+		Stage stage;
+		double megapixels;
+		Profiler::Clock::time_point start;
+	};
+
+	// Times its scope as a trace event, it is only checked for a recorded trace (so it can be in loops of the kernels)
+	class ScopedTrace
+	{
+	public:
+		explicit ScopedTrace(const char *name) : name(Profiler::IsTracing() ? name : nullptr)
+		{
+			if (this->name != nullptr)
+				start = Profiler::Clock::now();
+		}
+		~ScopedTrace()
+		{
+			if (name != nullptr)
+				Profiler::RecordTrace(name, start, Profiler::Clock::now());
+		}
+
+		ScopedTrace(const ScopedTrace &) = delete;
+		ScopedTrace &operator=(const ScopedTrace &) = delete;
+
+	private:
+		const char *name;
+		Profiler::Clock::time_point start;
+	};
+}
+
+#define DITHER_PROFILE_CONCAT_(a, b) a##b
+#define DITHER_PROFILE_CONCAT(a, b) DITHER_PROFILE_CONCAT_(a, b)
+
+#ifdef DITHER_PROFILE
+// Times the rest of the scope as a stage, megapixels give the MP/s of the stage
+#define DITHER_TIME(stage, megapixels) Dithering::ScopedTimer DITHER_PROFILE_CONCAT(profileTimer, __LINE__)(stage, megapixels)
+// Times the rest of the scope as an event of the trace (name has to be a string literal)
+#define DITHER_TRACE(name) Dithering::ScopedTrace DITHER_PROFILE_CONCAT(profileTrace, __LINE__)(name)
+#else
+#define DITHER_TIME(stage, megapixels) ((void)0)
+#define DITHER_TRACE(name) ((void)0)
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "kernels.h"
+
+#include <vector>
+
+// Resizing fused into dithering, the kernels resample every row right before dithering it so the resized image is never stored
+namespace Dithering
+{
+	enum class ResampleFilter
+	{
+		Box,		// Average of the covered pixels (nearest pixel when enlarging)
+		Bilinear,	// Triangle filter, widened when shrinking so every pixel counts
+		Lanczos		// Lanczos with 3 lobes, the sharpest one
+	};
+
+	// Parses box, bilinear or lanczos (case insensitive)
+	bool ParseResampleFilter(const char *text, ResampleFilter &filter);
+
+	// Size of an image resized to targetWidth x targetHeight, a zero keeps the aspect ratio and two zeros keep the size
+	void GetResizedSize(int width, int height, int targetWidth, int targetHeight, int &resizedWidth, int &resizedHeight);
+
+	// Resamples rows of a source image at another size, separable filter weights are computed once for the whole image
+	// Rows are computed independently (vertical pass over the source rows, then the horizontal pass), so threads can resample different rows at once
+	class Resampler
+	{
+	public:
+		Resampler(const PixelBuffer &source, int width, int height, ResampleFilter filter);
+
+		int GetWidth() const { return (int)horizontal.count.size(); }
+		int GetHeight() const { return (int)vertical.count.size(); }
+
+		// Writes width pixels of row y (starting at column x) of the resized image
+		// The format is the format of the source or grayscale, which gets the luminance of the resampled colors (of linear light when linear is set)
+		void ResampleRow(int y, int x, int width, byte *destination, Format format, bool linear = false) const;
+
+	private:
+		// Source pixels that make every pixel of the resized image along one axis, every pixel has maxTaps weights (the unused ones are 0)
+		struct Taps
+		{
+			std::vector<int> start;
+			std::vector<int> count;
+			std::vector<float> weights;
+			int maxTaps = 0;
+		};
+
+		static Taps ComputeTaps(int sourceSize, int targetSize, ResampleFilter filter);
+
+		PixelBuffer source;
+		Taps horizontal;
+		Taps vertical;
+	};
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Dithering
+{
+	// Pool of worker threads that split loops into ranges and run them in parallel
+	class ThreadPool
+	{
+	public:
+		// threadCount includes the calling thread, so threadCount - 1 workers are started
+		explicit ThreadPool(int threadCount);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+
+		int GetThreadCount() const { return (int)workers.size() + 1; }
+
+		// Calls function(begin, end) for ranges of at most grain items that cover [0, count) and waits for all of them
+		// At most threads threads (including the calling one) work on the ranges
+		// Nested calls (or calls while the pool is busy) run on the calling thread
+		void ParallelFor(int count, int grain, int threads, const std::function<void(int, int)> &function);
+
+	private:
+		void WorkerLoop(int index);
+		void RunRanges();
+
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::mutex busy;
+		std::condition_variable wake;
+		std::condition_variable finished;
+
+		// Current job
+		const std::function<void(int, int)> *job = nullptr;
+		int jobCount = 0;
+		int jobGrain = 1;
+		std::atomic<int> nextBegin{0};
+		int activeWorkers = 0;
+		int runningWorkers = 0;
+		unsigned generation = 0;
+		bool stopping = false;
+	};
+
+	// Requested thread count, or DITHER_THREADS or the number of cores when the request is 0
+	int GetThreadCount(int requested);
+	// Shared pool with at least threadCount threads, a bigger one is created when more threads are needed
+	std::shared_ptr<ThreadPool> GetThreadPool(int threadCount);
+	// Splits the rows of an image into bands and processes them in parallel (threadCount is resolved with GetThreadCount)
+	void ParallelRows(int threadCount, int height, const std::function<void(int, int)> &function);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "kernels.h"
+
+// Vectorized compare-and-select used by the ordered dithering kernels
+namespace Dithering
+{
+	// Period of a threshold row has to be a multiple of this (width of the widest vector in bytes)
+	constexpr int thresholdAlignment = 32;
+
+	// Threshold pattern tiled to whole vectors, one row of bytes for every row of the pattern
+	struct ThresholdTable
+	{
+		std::vector<byte> thresholds; // rows * period bytes
+		std::vector<byte> colorMask;  // 255 for color bytes, 0 for alpha bytes that are copied
+		int rows;
+		int period;
+	};
+
+	// Builds the table for a pattern indexed as pattern[(x % patternSize) * patternSize + y % patternSize]
+	ThresholdTable BuildThresholdTable(const byte *pattern, int patternSize, Format format);
+
+	// Sets every color byte of the row to 255 if it is higher than its threshold, or 0 otherwise
+	// The thresholds and mask repeat every period bytes, the best instruction set is picked at startup
+	void ThresholdRow(const byte *in, byte *out, int count, const byte *thresholds, const byte *colorMask, int period);
+}
@@ -0,0 +1,954 @@
+#include "batch.h"
+#include "boundedQueue.h"
+#include "dither.h"
+#include "imageFile.h"
+#include "mappedFile.h"
+#include "netpbm.h"
+#include "profiler.h"
+#include "threadPool.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Dithering
+{
+	//Variant of an input that moves between the stages of the pipeline
+	//Decoded input shared by the variants of a job, users counts the variants that still read it
+	//Only the variant that takes users to 0 can reuse the pixels, the acq_rel updates make the reads of the others happen before that
+	struct SharedImage
+	{
+		ImageFile image;
+		std::atomic<int> users{0};
+	};
+
+	struct BatchItem
+	{
+		const BatchJob *job = nullptr;
+		int variant = 0;
+		std::shared_ptr<SharedImage> source;	//Decoded input, shared by its variants and only read
+		ImageFile image;						//Result
+	};
+
+	//Reports the result of a variant of a job (error is nullptr when it was saved) with the size of the result
+	using ReportFunction = std::function<void(const BatchJob &job, int variant, const char *error, int width, int height)>;
+
+	//Starts count threads running function and calls onDone when the last one of them finishes
+	static void StartStage(std::vector<std::thread> &threads, int count, const std::function<void()> &function, const std::function<void()> &onDone)
+	{
+		auto running = std::make_shared<std::atomic<int>>(count);
+		for (int i = 0; i < count; i++)
+		{
+			threads.emplace_back([=]
+			{
+				function();
+				if (running->fetch_sub(1) == 1)
+					onDone();
+			});
+		}
+	}
+
+	//Output of one variant of a streamed file
+	struct StreamOutput
+	{
+		NetpbmWriter writer;
+		std::unique_ptr<StreamDitherer> ditherer;
+		std::vector<byte> strip;
+		Format format;
+		const char *error = nullptr;
+	};
+
+	//Dithers a netpbm file strip by strip, so its size doesn't matter, every strip is read once and dithered for all the variants
+	static void StreamFile(const BatchJob &job, const BatchOptions &options, const std::vector<Palette> &palettes, const ReportFunction &report)
+	{
+		int variantCount = (int)options.variants.size();
+		NetpbmReader reader;
+		if (!reader.Open(job.input.c_str()))
+		{
+			for (int v = 0; v < variantCount; v++)
+				report(job, v, "can't load the image", 0, 0);
+			return;
+		}
+		int width = reader.GetWidth();
+		int height = reader.GetHeight();
+		Format format = reader.GetFormat();
+
+		//Grayscale results are converted by the kernel, so only the gray strip is written
+		std::vector<StreamOutput> outputs(variantCount);
+		for (int v = 0; v < variantCount; v++)
+		{
+			const BatchVariant &variant = options.variants[v];
+			StreamOutput &output = outputs[v];
+			output.format = variant.colored ? format : Format::Grayscale;
+			if (variant.palette.extractCount > 0)
+				output.error = "extracted palettes need the whole image, it can't be streamed";
+			else if (!output.writer.Open(job.outputs[v].c_str(), width, height, output.format))
+				output.error = "can't save the image";
+			else
+			{
+				Settings settings = options.settings;
+				settings.palette = variant.palette.colors.empty() ? nullptr : &palettes[v];
+				output.ditherer.reset(new StreamDitherer(width, output.format, variant.algorithm, settings));
+				output.strip.resize((size_t)options.stripRows * width * (int)output.format);
+			}
+		}
+
+		std::vector<byte> strip((size_t)options.stripRows * width * (int)format);
+		const char *readError = nullptr;
+		for (int y = 0; y < height && readError == nullptr; y += options.stripRows)
+		{
+			int rows = height - y < options.stripRows ? height - y : options.stripRows;
+			PixelBuffer source = {strip.data(), width, rows, width * (int)format, format};
+			bool read;
+			{
+				DITHER_TIME(Stage::Load, (double)width * rows / 1e6);
+				read = reader.ReadRows(source);
+			}
+			if (!read)
+			{
+				readError = "can't load the image";
+				break;
+			}
+			for (StreamOutput &output : outputs)
+			{
+				if (output.error != nullptr)
+					continue;
+				PixelBuffer result = {output.strip.data(), width, rows, width * (int)output.format, output.format};
+				output.ditherer->DitherStripInto(source, result);
+				DITHER_TIME(Stage::Save, (double)width * rows / 1e6);
+				if (!output.writer.WriteRows(result))
+					output.error = "can't save the image";
+			}
+		}
+
+		for (int v = 0; v < variantCount; v++)
+		{
+			StreamOutput &output = outputs[v];
+			if (output.error == nullptr)
+			{
+				DITHER_TIME(Stage::Save, 0.0);
+				output.error = output.writer.Close() ? readError : "can't save the image";
+			}
+			report(job, v, output.error, width, height);
+		}
+	}
+
+	static bool IsRawFile(const std::string &path)
+	{
+		return path.size() >= 4 && strcasecmp(path.c_str() + path.size() - 4, ".raw") == 0;
+	}
+
+	//Dithers source into destination, which has the format and size of the result (the kernel converts and resizes the rows)
+	//Extracted palettes are made from the gray levels of grayscale results, or from the colors of the source when it is resized
+	static bool DitherImage(const PixelBuffer &source, PixelBuffer &destination, const BatchVariant &variant, const Settings &options, const Palette *palette)
+	{
+		Settings settings = options;
+		settings.palette = palette;
+		Palette imagePalette;
+		bool resized = destination.width != source.width || destination.height != source.height;
+		if (variant.palette.extractCount > 0)
+		{
+			if (destination.format != source.format && !resized)
+			{
+				ConvertToGrayscale(source, destination, settings.linear);
+				imagePalette = MakePalette(variant.palette, destination);
+				settings.palette = &imagePalette;
+				return Dither(destination.data, destination.width, destination.height, destination.stride, destination.format, variant.algorithm, true, settings);
+			}
+			imagePalette = MakePalette(variant.palette, source);
+			settings.palette = &imagePalette;
+		}
+
+		if (resized)
+			return DitherResized(source, destination, variant.filter, variant.algorithm, settings);
+		if (source.data == destination.data)
+			return Dither(destination.data, destination.width, destination.height, destination.stride, destination.format, variant.algorithm, true, settings);
+		return DitherInto(source, destination, variant.algorithm, settings);
+	}
+
+	//Maps a netpbm or raw file and gives its pixels, returns the error or nullptr
+	static const char *MapInput(const BatchJob &job, const BatchOptions &options, MappedFile &input, PixelBuffer &source)
+	{
+		if (!input.OpenRead(job.input.c_str()))
+			return "can't load the image";
+
+		size_t offset = 0;
+		int width, height;
+		Format format;
+		if (IsRawFile(job.input))
+		{
+			width = options.raw.width;
+			height = options.raw.height;
+			format = options.raw.format;
+			if (width <= 0 || height <= 0)
+				return "raw images need their size";
+			if (input.GetSize() < (size_t)width * height * (int)format)
+				return "the raw image is smaller than its size";
+		}
+		else if (!ParseNetpbmHeader(input.GetData(), input.GetSize(), width, height, format, offset))
+			return "can't load the image";
+		source = {input.GetData() + offset, width, height, width * (int)format, format};
+		return nullptr;
+	}
+
+	//Dithers one variant of a mapped file without decoding it, returns the error or nullptr when the result was saved
+	//The kernels read the rows from the input mapping and write them to the output mapping, so no image is allocated
+	//Outputs that change the pixels (pbm, png, ...) are dithered to an image and saved as usual
+	static const char *MapVariant(const PixelBuffer &source, const std::string &path, const BatchVariant &variant, const BatchOptions &options,
+								  const Palette *palette, int &width, int &height)
+	{
+		//Grayscale results are converted and resized by the kernel as it reads the rows
+		Format ditherFormat = variant.colored ? source.format : Format::Grayscale;
+		GetResizedSize(source.width, source.height, variant.resizeWidth, variant.resizeHeight, width, height);
+		ImageFile image;
+		MappedFile output;
+		PixelBuffer destination;
+		std::string header = GetNetpbmHeader(path.c_str(), width, height, ditherFormat);
+		if (!header.empty())
+		{
+			if (!output.Create(path.c_str(), header.size() + (size_t)width * height * (int)ditherFormat))
+				return "can't save the image";
+			memcpy(output.GetData(), header.data(), header.size());
+			destination = {output.GetData() + header.size(), width, height, width * (int)ditherFormat, ditherFormat};
+		}
+		else
+		{
+			image.width = width;
+			image.height = height;
+			image.format = ditherFormat;
+			image.pixels.resize((size_t)width * height * (int)ditherFormat);
+			destination = image.GetBuffer();
+		}
+
+		if (!DitherImage(source, destination, variant, options.settings, palette))
+			return "can't dither the image";
+
+		if (!header.empty())
+		{
+			DITHER_TIME(Stage::Save, 0.0);
+			return output.Close() ? nullptr : "can't save the image";
+		}
+		return SaveImageFile(path.c_str(), destination) ? nullptr : "can't save the image";
+	}
+
+	//Maps a file once and dithers all its variants from the mapping
+	static void MapFile(const BatchJob &job, const BatchOptions &options, const std::vector<Palette> &palettes, const ReportFunction &report)
+	{
+		MappedFile input;
+		PixelBuffer source = {};
+		const char *inputError = MapInput(job, options, input, source);
+		for (int v = 0; v < (int)options.variants.size(); v++)
+		{
+			const BatchVariant &variant = options.variants[v];
+			int width = source.width;
+			int height = source.height;
+			const char *error = inputError;
+			if (error == nullptr)
+				error = MapVariant(source, job.outputs[v], variant, options, variant.palette.colors.empty() ? nullptr : &palettes[v], width, height);
+			report(job, v, error, width, height);
+		}
+	}
+
+	//Whether an input is mapped instead of decoded (raw files have no other way)
+	static bool IsMappedInput(const BatchJob &job, const BatchOptions &options)
+	{
+		//Frames of a temporal sequence need their decoded source
+		return IsRawFile(job.input) || (options.mapFiles && !options.temporal && IsNetpbmInput(job.input.c_str()));
+	}
+
+	//Whether every result of a netpbm input can be streamed (resizing needs the rows around every row of the result)
+	static bool CanStream(const BatchJob &job, const BatchOptions &options)
+	{
+		if (options.stripRows <= 0 || options.temporal || !IsNetpbmInput(job.input.c_str()))
+			return false;
+		for (int v = 0; v < (int)options.variants.size(); v++)
+		{
+			const BatchVariant &variant = options.variants[v];
+			if (!IsNetpbmOutput(job.outputs[v].c_str()) || variant.resizeWidth > 0 || variant.resizeHeight > 0)
+				return false;
+		}
+		return true;
+	}
+
+	//Images of the pipeline that were saved, later images take their memory instead of allocating it (frames of a sequence have one size)
+	class ImagePool
+	{
+	public:
+		explicit ImagePool(int capacity) : capacity(capacity) {}
+
+		ImageFile Take()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (images.empty())
+				return ImageFile();
+			ImageFile image = std::move(images.back());
+			images.pop_back();
+			return image;
+		}
+
+		void Give(ImageFile &&image)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if ((int)images.size() < capacity)
+				images.push_back(std::move(image));
+		}
+
+		//Gives the source of an item back when no other variant uses it
+		void Release(BatchItem &item)
+		{
+			if (item.source != nullptr && item.source->users.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				Give(std::move(item.source->image));
+			item.source.reset();
+		}
+
+	private:
+		std::mutex mutex;
+		std::vector<ImageFile> images;
+		int capacity;
+	};
+
+	//Whether a variant of a sequence goes through the temporal filter, point-wise algorithms give the same result for the same source anyway
+	static bool IsTemporal(const BatchOptions &options, int variant)
+	{
+		return options.temporal && !Kernels::GetAlgorithms()[options.variants[variant].algorithm].pointWise;
+	}
+
+	//Makes the frames of a sequence temporally stable: error diffusion keeps the previous result of the pixels whose source didn't change,
+	//so the frames of every variant of a sequence are dithered in frame order (on the thread pool), decoded frames come in any order and
+	//wait for their turn, every sequence starts over with its first frame
+	class TemporalFilter
+	{
+	public:
+		//Dithers the source of an item into its image, the frame is nullptr for the first frame
+		using DitherFunction = std::function<bool(BatchItem &item, const TemporalFrame *frame)>;
+
+		//At most capacity frames of a variant wait while one of its frames is dithered, the decoders don't get further ahead
+		TemporalFilter(const std::vector<BatchJob> &jobs, int threshold, int capacity, const DitherFunction &dither, BoundedQueue<BatchItem> &output,
+					   ImagePool &pool)
+			: threshold(threshold), capacity(capacity), dither(dither), output(output), pool(pool)
+		{
+			for (const BatchJob &job : jobs)
+			{
+				int &frames = frameCounts[job.sequence];
+				frames = frames > job.frame + 1 ? frames : job.frame + 1;
+			}
+		}
+
+		void Add(BatchItem &&item)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			VariantState &state = GetState(*item.job, item.variant);
+			int frame = item.job->frame;
+			state.waiting[frame] = std::move(item);
+			//The thread that dithers takes this frame when its turn comes, the wait ends when that thread runs out of frames too
+			if (state.busy)
+				changed.wait(lock, [&] { return !state.busy || (int)state.waiting.size() < capacity; });
+			else
+				Flush(state, lock);
+		}
+
+		//Frame that failed, the next one is compared to the frame before it
+		void Skip(const BatchJob &job, int variant)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			VariantState &state = GetState(job, variant);
+			state.waiting[job.frame] = BatchItem();
+			if (!state.busy)
+				Flush(state, lock);
+		}
+
+	private:
+		struct VariantState
+		{
+			int frames = 0;						//Frames of the sequence
+			int nextFrame = 0;
+			bool busy = false;					//A thread dithers the frames of this variant
+			std::map<int, BatchItem> waiting;	//Frames that came before the ones in front of them, skipped frames have no job
+			ImageFile reference;				//Source of every pixel of result when that pixel was dithered
+			ImageFile result;					//Last frame that was dithered
+			std::vector<byte> keep;				//Pixels of the frame that keep their result
+		};
+
+		//State of a variant of the sequence of a job, made when its first frame comes
+		VariantState &GetState(const BatchJob &job, int variant)
+		{
+			VariantState &state = states[{job.sequence, variant}];
+			state.frames = frameCounts[job.sequence];
+			return state;
+		}
+
+		//Dithers the frames that are next, only the busy thread touches the images of the state, so the lock is only held to take frames
+		void Flush(VariantState &state, std::unique_lock<std::mutex> &lock)
+		{
+			state.busy = true;
+			while (!state.waiting.empty() && state.waiting.begin()->first == state.nextFrame)
+			{
+				BatchItem item = std::move(state.waiting.begin()->second);
+				state.waiting.erase(state.waiting.begin());
+				state.nextFrame++;
+				changed.notify_all();
+				if (item.job == nullptr)
+					continue;
+
+				lock.unlock();
+				bool finished = Dither(state, item);
+				pool.Release(item);
+				if (finished)
+					output.Push(std::move(item));
+				lock.lock();
+			}
+			//The images of a finished sequence aren't needed anymore
+			if (state.nextFrame == state.frames)
+			{
+				state.reference = ImageFile();
+				state.result = ImageFile();
+				state.keep = std::vector<byte>();
+			}
+			state.busy = false;
+			changed.notify_all();
+		}
+
+		//Pixels whose source stayed within the threshold of the source of their last result keep that result
+		bool Dither(VariantState &state, BatchItem &item)
+		{
+			const ImageFile &source = item.source->image;
+			size_t pixels = (size_t)source.width * source.height;
+			int sourceBytes = (int)source.format;
+			bool continued = state.result.width == source.width && state.result.height == source.height && state.reference.format == source.format;
+			if (continued)
+			{
+				DITHER_TRACE("Temporal");
+				state.keep.resize(pixels);
+				byte *reference = state.reference.pixels.data();
+				const byte *current = source.pixels.data();
+				for (size_t i = 0; i < pixels; i++, reference += sourceBytes, current += sourceBytes)
+				{
+					bool changed = false;
+					for (int c = 0; c < sourceBytes; c++)
+						changed = changed || abs(current[c] - reference[c]) > threshold;
+					if (changed)
+						memcpy(reference, current, sourceBytes);
+					state.keep[i] = !changed;
+				}
+			}
+			else
+			{
+				state.reference.width = source.width;
+				state.reference.height = source.height;
+				state.reference.format = source.format;
+				state.reference.pixels.assign(source.pixels.begin(), source.pixels.end());
+			}
+
+			TemporalFrame frame = {state.keep.data(), state.result.pixels.data()};
+			if (!dither(item, continued ? &frame : nullptr))
+			{
+				//The next frame starts over
+				state.result.width = 0;
+				return false;
+			}
+			state.result.width = item.image.width;
+			state.result.height = item.image.height;
+			state.result.format = item.image.format;
+			state.result.pixels.assign(item.image.pixels.begin(), item.image.pixels.end());
+			return true;
+		}
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::map<int, int> frameCounts;
+		std::map<std::pair<int, int>, VariantState> states;	//By sequence and variant
+		int threshold;
+		int capacity;
+		DitherFunction dither;
+		BoundedQueue<BatchItem> &output;
+		ImagePool &pool;
+	};
+
+	static bool IsSequenceImage(const std::filesystem::path &path)
+	{
+		static const char *extensions[] = {".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd", ".pic", ".pgm", ".ppm", ".pnm", ".pam", ".raw"};
+		std::string extension = path.extension().string();
+		for (const char *known : extensions)
+		{
+			if (strcasecmp(extension.c_str(), known) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	//Compares names with their numbers as numbers, so frame2 comes before frame10
+	static bool IsBeforeNaturally(const std::string &a, const std::string &b)
+	{
+		size_t i = 0, j = 0;
+		while (i < a.size() && j < b.size())
+		{
+			if (isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j]))
+			{
+				size_t aEnd = i, bEnd = j;
+				while (aEnd < a.size() && isdigit((unsigned char)a[aEnd]))
+					aEnd++;
+				while (bEnd < b.size() && isdigit((unsigned char)b[bEnd]))
+					bEnd++;
+				//Leading zeros don't count, then the longer number is the bigger one
+				while (i + 1 < aEnd && a[i] == '0')
+					i++;
+				while (j + 1 < bEnd && b[j] == '0')
+					j++;
+				if (aEnd - i != bEnd - j)
+					return aEnd - i < bEnd - j;
+				int order = a.compare(i, aEnd - i, b, j, bEnd - j);
+				if (order != 0)
+					return order < 0;
+				i = aEnd;
+				j = bEnd;
+			}
+			else
+			{
+				if (a[i] != b[j])
+					return a[i] < b[j];
+				i++;
+				j++;
+			}
+		}
+		return a.size() - i < b.size() - j;
+	}
+
+	//Whether a path has exactly one number conversion (%d, %4d or %04d) and no other one (%% is a percent sign)
+	static bool IsFramePattern(const char *path)
+	{
+		int numbers = 0;
+		for (const char *c = path; *c != '\0'; c++)
+		{
+			if (*c != '%')
+				continue;
+			c++;
+			if (*c == '%')
+				continue;
+			while (isdigit((unsigned char)*c))
+				c++;
+			if (*c != 'd')
+				return false;
+			numbers++;
+		}
+		return numbers == 1;
+	}
+
+	bool GetSequenceFrames(const char *path, std::vector<std::string> &frames, std::string &error)
+	{
+		frames.clear();
+		std::error_code code;
+		if (std::filesystem::is_directory(path, code))
+		{
+			for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(path, code))
+			{
+				if (entry.is_regular_file(code) && IsSequenceImage(entry.path()))
+					frames.push_back(entry.path().string());
+			}
+			std::sort(frames.begin(), frames.end(), IsBeforeNaturally);
+		}
+		else if (IsFramePattern(path))
+		{
+			char name[4096];
+			for (int start = 0; start <= 1 && frames.empty(); start++)
+			{
+				for (int number = start;; number++)
+				{
+					snprintf(name, sizeof(name), path, number);
+					if (!std::filesystem::is_regular_file(name, code))
+						break;
+					frames.push_back(name);
+				}
+			}
+		}
+		else
+		{
+			error = std::string(path) + " is neither a directory nor a frame pattern like frame_%04d.png";
+			return false;
+		}
+
+		if (frames.empty())
+		{
+			error = std::string("no frames in ") + path;
+			return false;
+		}
+		return true;
+	}
+
+	bool SetManifestValue(ManifestVariant &variant, const std::string &key, const std::string &value)
+	{
+		BatchVariant &settings = variant.variant;
+		if (key == "algorithm")
+		{
+			settings.algorithm = FindAlgorithm(value.c_str());
+			return settings.algorithm >= 0;
+		}
+		if (key == "colored")
+		{
+			settings.colored = value == "1";
+			return value == "0" || value == "1";
+		}
+		if (key == "palette")
+		{
+			//- dithers to black and white when the defaults have a palette
+			settings.palette = PaletteSpec();
+			return value == "-" || ParsePaletteSpec(value.c_str(), settings.palette);
+		}
+		if (key == "resize")
+		{
+			char end;
+			return sscanf(value.c_str(), "%dx%d%c", &settings.resizeWidth, &settings.resizeHeight, &end) == 2 && settings.resizeWidth >= 0 &&
+				   settings.resizeHeight >= 0;
+		}
+		if (key == "filter")
+			return ParseResampleFilter(value.c_str(), settings.filter);
+		if (key == "format")
+		{
+			variant.format = value[0] == '.' ? value.substr(1) : value;
+			return IsSupportedOutput(("." + variant.format).c_str());
+		}
+		if (key == "suffix")
+		{
+			variant.suffix = value;
+			return true;
+		}
+		return false;
+	}
+
+	//Splits a line into its words, a word starting with # comments out the rest of the line
+	static std::vector<std::string> GetWords(const char *line)
+	{
+		std::vector<std::string> words;
+		while (true)
+		{
+			while (isspace((unsigned char)*line))
+				line++;
+			if (*line == '\0' || *line == '#')
+				return words;
+			const char *end = line;
+			while (*end != '\0' && !isspace((unsigned char)*end))
+				end++;
+			words.emplace_back(line, end);
+			line = end;
+		}
+	}
+
+	bool LoadBatchManifest(const char *path, const ManifestVariant &defaults, std::vector<ManifestVariant> &variants, std::string &error)
+	{
+		variants.clear();
+		FILE *file = fopen(path, "r");
+		if (file == nullptr)
+		{
+			error = std::string("can't open ") + path;
+			return false;
+		}
+
+		std::vector<bool> hasSuffix;
+		char line[1024];
+		for (int number = 1; fgets(line, sizeof(line), file) != nullptr; number++)
+		{
+			std::vector<std::string> words = GetWords(line);
+			if (words.empty())
+				continue;
+			ManifestVariant variant = defaults;
+			bool suffix = false;
+			for (const std::string &word : words)
+			{
+				size_t equals = word.find('=');
+				std::string key = word.substr(0, equals);
+				if (equals == std::string::npos || equals + 1 == word.size() || !SetManifestValue(variant, key, word.substr(equals + 1)))
+				{
+					error = "line " + std::to_string(number) + ": invalid setting " + word;
+					fclose(file);
+					return false;
+				}
+				suffix = suffix || key == "suffix";
+			}
+			variants.push_back(variant);
+			hasSuffix.push_back(suffix);
+		}
+		fclose(file);
+		if (variants.empty())
+		{
+			error = "no variants";
+			return false;
+		}
+
+		for (int i = 0; i < (int)variants.size(); i++)
+		{
+			if (!hasSuffix[i] && variants.size() > 1)
+				variants[i].suffix += "_" + std::to_string(i + 1);
+			for (int j = 0; j < i; j++)
+			{
+				if (variants[j].suffix == variants[i].suffix && variants[j].format == variants[i].format)
+				{
+					error = "variants " + std::to_string(j + 1) + " and " + std::to_string(i + 1) + " write the same files";
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool IsBatchManifest(const char *path)
+	{
+		FILE *file = fopen(path, "r");
+		if (file == nullptr)
+			return false;
+		char line[1024];
+		bool manifest = false;
+		while (fgets(line, sizeof(line), file) != nullptr)
+		{
+			std::vector<std::string> words = GetWords(line);
+			if (!words.empty())
+			{
+				manifest = words[0].find('=') != std::string::npos;
+				break;
+			}
+		}
+		fclose(file);
+		return manifest;
+	}
+
+	BatchStats RunBatch(const std::vector<BatchJob> &jobs, const BatchOptions &options, const std::function<void(const BatchFileStatus &)> &onFile)
+	{
+		auto start = std::chrono::steady_clock::now();
+		int variantCount = (int)options.variants.size();
+		int results = (int)jobs.size() * variantCount;
+		int workers = options.workers > 0 ? options.workers : GetThreadCount(0);
+		workers = workers < results ? workers : results;
+
+		BatchStats stats;
+		stats.files = results;
+		if (workers == 0)
+			return stats;
+
+		//Decoding and encoding don't use the thread pool, every stage gets its own threads and the kernels share the pool
+		BoundedQueue<BatchItem> decoded(options.queueDepth > 0 ? options.queueDepth : workers);
+		BoundedQueue<BatchItem> dithered(options.queueDepth > 0 ? options.queueDepth : workers);
+
+		std::mutex statusMutex;
+		ReportFunction report = [&](const BatchJob &job, int variant, const char *error, int width, int height)
+		{
+			std::lock_guard<std::mutex> lock(statusMutex);
+			if (error != nullptr)
+				stats.failed++;
+			else
+				stats.megapixels += (double)width * height / 1e6;
+			if (onFile)
+				onFile({&job, variant, error, width, height});
+		};
+
+		std::vector<Palette> palettes = MakeBatchPalettes(options);
+		ImagePool pool(workers * 2 + (options.queueDepth > 0 ? options.queueDepth : workers));
+
+		//Grayscale images are saved with one chanel, the same as the application does
+		//The kernel converts and resizes the rows as it dithers them, so the input is only read and only the results are allocated
+		auto ditherItem = [&](BatchItem &item, const TemporalFrame *frame)
+		{
+			const BatchVariant &variant = options.variants[item.variant];
+			ImageFile &input = item.source->image;
+			int width, height;
+			GetResizedSize(input.width, input.height, variant.resizeWidth, variant.resizeHeight, width, height);
+			Format format = variant.colored ? input.format : Format::Grayscale;
+			bool resized = width != input.width || height != input.height;
+
+			//The last variant that still needs the input dithers it in place when the result has its format and size
+			//Frames of the temporal filter keep their source for comparing it with the next frame
+			PixelBuffer source;
+			int lastUser = 1;
+			if (!IsTemporal(options, item.variant) && format == input.format && !resized &&
+				item.source->users.compare_exchange_strong(lastUser, 0, std::memory_order_acq_rel))
+			{
+				item.image = std::move(input);
+				item.source.reset();
+				source = item.image.GetBuffer();
+			}
+			else
+			{
+				item.image = pool.Take();
+				item.image.width = width;
+				item.image.height = height;
+				item.image.format = format;
+				item.image.pixels.resize((size_t)width * height * (int)format);
+				source = input.GetBuffer();
+			}
+			PixelBuffer buffer = item.image.GetBuffer();
+			Settings settings = options.settings;
+			//The previous result has the pixels of the frame only when the frames aren't resized
+			if (!resized)
+				settings.temporal = frame;
+			bool finished = DitherImage(source, buffer, variant, settings, variant.palette.colors.empty() ? nullptr : &palettes[item.variant]);
+			if (!finished)
+				report(*item.job, item.variant, "can't dither the image", item.image.width, item.image.height);
+			return finished;
+		};
+
+		int queueDepth = options.queueDepth > 0 ? options.queueDepth : workers;
+		TemporalFilter temporal(jobs, options.temporalThreshold, queueDepth, ditherItem, dithered, pool);
+		//Frames that don't reach the temporal filter still have to let the next ones through
+		auto skipFrame = [&](const BatchJob &job, int variant)
+		{
+			if (IsTemporal(options, variant))
+				temporal.Skip(job, variant);
+		};
+
+		std::atomic<int> nextJob{0};
+		std::vector<std::thread> threads;
+
+		StartStage(threads, workers, [&]
+		{
+			for (int i = nextJob.fetch_add(1); i < (int)jobs.size(); i = nextJob.fetch_add(1))
+			{
+				const BatchJob &job = jobs[i];
+				//Mapped and streamed files go through all the stages right here
+				if (IsMappedInput(job, options))
+				{
+					MapFile(job, options, palettes, report);
+					for (int v = 0; v < variantCount; v++)
+						skipFrame(job, v);
+					continue;
+				}
+				if (CanStream(job, options))
+				{
+					StreamFile(job, options, palettes, report);
+					continue;
+				}
+
+				//Every variant gets the same decoded image
+				std::shared_ptr<SharedImage> source = std::make_shared<SharedImage>();
+				source->image = pool.Take();
+				source->users.store(variantCount, std::memory_order_relaxed);
+				if (!LoadImageFile(job.input.c_str(), source->image))
+				{
+					for (int v = 0; v < variantCount; v++)
+					{
+						report(job, v, "can't load the image", 0, 0);
+						skipFrame(job, v);
+					}
+					continue;
+				}
+				for (int v = 0; v < variantCount; v++)
+				{
+					BatchItem item;
+					item.job = &job;
+					item.variant = v;
+					item.source = source;
+					decoded.Push(std::move(item));
+				}
+			}
+		}, [&] { decoded.Close(); });
+
+		StartStage(threads, workers, [&]
+		{
+			BatchItem item;
+			while (decoded.Pop(item))
+			{
+				if (IsTemporal(options, item.variant))
+				{
+					temporal.Add(std::move(item));
+					continue;
+				}
+				bool finished = ditherItem(item, nullptr);
+				//The input is given back as soon as its last variant is dithered
+				pool.Release(item);
+				if (finished)
+					dithered.Push(std::move(item));
+			}
+		}, [&] { dithered.Close(); });
+
+		StartStage(threads, workers, [&]
+		{
+			BatchItem item;
+			while (dithered.Pop(item))
+			{
+				bool saved = SaveImageFile(item.job->outputs[item.variant].c_str(), item.image.GetBuffer());
+				report(*item.job, item.variant, saved ? nullptr : "can't save the image", item.image.width, item.image.height);
+				pool.Give(std::move(item.image));
+			}
+		}, [] {});
+
+		for (std::thread &thread : threads)
+			thread.join();
+
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return stats;
+	}
+
+	std::vector<Palette> MakeBatchPalettes(const BatchOptions &options)
+	{
+		//Fixed palettes are shared by all the images, extracted palettes are made for every image
+		std::vector<Palette> palettes(options.variants.size());
+		for (int v = 0; v < (int)options.variants.size(); v++)
+		{
+			if (!options.variants[v].palette.colors.empty())
+				palettes[v] = MakePalette(options.variants[v].palette, PixelBuffer{});
+		}
+		return palettes;
+	}
+
+	void ProcessBatchJob(const BatchJob &job, const BatchOptions &options, const std::vector<Palette> &palettes, BatchArena &arena,
+						 const std::function<void(const BatchFileStatus &)> &onFile)
+	{
+		ReportFunction report = [&](const BatchJob &job, int variant, const char *error, int width, int height)
+		{
+			if (onFile)
+				onFile({&job, variant, error, width, height});
+		};
+		if (IsMappedInput(job, options))
+		{
+			MapFile(job, options, palettes, report);
+			return;
+		}
+		if (CanStream(job, options))
+		{
+			StreamFile(job, options, palettes, report);
+			return;
+		}
+
+		int variantCount = (int)options.variants.size();
+		ImageFile &input = arena.input;
+		if (!LoadImageFile(job.input.c_str(), input))
+		{
+			for (int v = 0; v < variantCount; v++)
+				report(job, v, "can't load the image", 0, 0);
+			return;
+		}
+		for (int v = 0; v < variantCount; v++)
+		{
+			const BatchVariant &variant = options.variants[v];
+			int width, height;
+			GetResizedSize(input.width, input.height, variant.resizeWidth, variant.resizeHeight, width, height);
+			Format format = variant.colored ? input.format : Format::Grayscale;
+
+			//The last variant dithers the input in place when the result has its format and size, the others reuse the result of the arena
+			ImageFile *result = &input;
+			if (v + 1 < variantCount || format != input.format || width != input.width || height != input.height)
+			{
+				result = &arena.result;
+				result->width = width;
+				result->height = height;
+				result->format = format;
+				result->pixels.resize((size_t)width * height * (int)format);
+			}
+			PixelBuffer source = input.GetBuffer();
+			PixelBuffer buffer = result->GetBuffer();
+			const char *error = nullptr;
+			if (!DitherImage(source, buffer, variant, options.settings, variant.palette.colors.empty() ? nullptr : &palettes[v]))
+				error = "can't dither the image";
+			else if (!SaveImageFile(job.outputs[v].c_str(), buffer))
+				error = "can't save the image";
+			report(job, v, error, width, height);
+		}
+	}
+}
@@ -0,0 +1,620 @@
+#include "daemon.h"
+#include "boundedQueue.h"
+#include "dither.h"
+#include "palette.h"
+#include "threadPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+namespace Dithering
+{
+	std::vector<std::string> SplitDaemonFields(const std::string &line)
+	{
+		std::vector<std::string> fields;
+		size_t begin = 0;
+		while (begin <= line.size())
+		{
+			size_t end = line.find('\t', begin);
+			end = end == std::string::npos ? line.size() : end;
+			fields.push_back(line.substr(begin, end - begin));
+			begin = end + 1;
+		}
+		return fields;
+	}
+
+#ifdef _WIN32
+	bool RunDaemon(const char *, const DaemonOptions &, std::string &error)
+	{
+		error = "the daemon needs Unix domain sockets";
+		return false;
+	}
+
+	void StopDaemon()
+	{
+	}
+
+	DaemonClient::~DaemonClient()
+	{
+	}
+
+	bool DaemonClient::Connect(const char *)
+	{
+		return false;
+	}
+
+	bool DaemonClient::Send(const std::string &)
+	{
+		return false;
+	}
+
+	bool DaemonClient::Receive(std::string &)
+	{
+		return false;
+	}
+
+	void DaemonClient::Close()
+	{
+	}
+#else
+	//Writes all the bytes, a client that went away doesn't raise SIGPIPE
+	static bool SendAll(int socket, const std::string &data)
+	{
+		size_t offset = 0;
+		while (offset < data.size())
+		{
+			ssize_t sent = send(socket, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent <= 0)
+				return false;
+			offset += sent;
+		}
+		return true;
+	}
+
+	//Reads the next line, received keeps the bytes that came after it
+	static bool ReceiveLine(int socket, std::string &received, std::string &line)
+	{
+		size_t end;
+		while ((end = received.find('\n')) == std::string::npos)
+		{
+			char buffer[4096];
+			ssize_t count = recv(socket, buffer, sizeof(buffer), 0);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return false;
+			received.append(buffer, count);
+		}
+		line = received.substr(0, end);
+		received.erase(0, end + 1);
+		return true;
+	}
+
+	static bool GetSocketAddress(const char *path, sockaddr_un &address)
+	{
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (strlen(path) >= sizeof(address.sun_path))
+			return false;
+		strcpy(address.sun_path, path);
+		return true;
+	}
+
+	static int ConnectSocket(const char *path)
+	{
+		sockaddr_un address;
+		if (!GetSocketAddress(path, address))
+			return -1;
+		int client = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (client < 0)
+			return -1;
+		if (connect(client, (const sockaddr *)&address, sizeof(address)) != 0)
+		{
+			close(client);
+			return -1;
+		}
+#ifdef SO_NOSIGPIPE
+		int on = 1;
+		setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+		return client;
+	}
+
+	//Replies that can wait for a client and how long sending can wait for it to read, a client past either is dropped
+	constexpr size_t maxPendingReplies = 1 << 20;
+	constexpr int replyTimeoutSeconds = 10;
+
+	//Replies of a connection, sent by its own thread so a client that doesn't read them only stalls itself and never a worker
+	struct ReplyQueue
+	{
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::string pending;					//Lines that weren't sent yet
+		bool closed = false;					//No more replies come, the thread sends the ones left and closes the socket
+		bool dropped = false;					//The client stopped reading, its replies are thrown away
+		std::atomic<bool> finished{false};		//The thread is done
+	};
+
+	//Sends the replies of a connection until it is closed, then closes its socket
+	static void WriteReplies(int socket, std::shared_ptr<ReplyQueue> replies)
+	{
+		std::unique_lock<std::mutex> lock(replies->mutex);
+		while (true)
+		{
+			replies->ready.wait(lock, [&] { return !replies->pending.empty() || replies->closed; });
+			if (replies->pending.empty())
+				break;
+			std::string lines = std::move(replies->pending);
+			replies->pending.clear();
+			lock.unlock();
+			bool sent = SendAll(socket, lines);
+			lock.lock();
+			if (!sent && !replies->dropped)
+			{
+				replies->dropped = true;
+				shutdown(socket, SHUT_RDWR);
+			}
+		}
+		lock.unlock();
+		close(socket);
+		replies->finished = true;
+	}
+
+	//Client of the daemon, the replies of the workers are queued for the thread of its ReplyQueue
+	class DaemonConnection
+	{
+	public:
+		DaemonConnection(int socket, std::shared_ptr<ReplyQueue> replies) : socket(socket), replies(std::move(replies)) {}
+
+		//The thread of the replies closes the socket once it sent the last ones
+		~DaemonConnection()
+		{
+			std::lock_guard<std::mutex> lock(replies->mutex);
+			replies->closed = true;
+			replies->ready.notify_one();
+		}
+
+		DaemonConnection(const DaemonConnection &) = delete;
+		DaemonConnection &operator=(const DaemonConnection &) = delete;
+
+		int GetSocket() const { return socket; }
+
+		void Reply(const std::string &line)
+		{
+			std::lock_guard<std::mutex> lock(replies->mutex);
+			if (replies->dropped)
+				return;
+			//A client that doesn't read its replies is dropped instead of keeping all of them, its reader stops too
+			if (replies->pending.size() + line.size() >= maxPendingReplies)
+			{
+				replies->dropped = true;
+				replies->pending.clear();
+				shutdown(socket, SHUT_RDWR);
+				return;
+			}
+			replies->pending += line;
+			replies->pending += '\n';
+			replies->ready.notify_one();
+		}
+
+	private:
+		int socket;
+		std::shared_ptr<ReplyQueue> replies;
+	};
+
+	//Request that waits for a worker
+	struct DaemonJob
+	{
+		std::shared_ptr<DaemonConnection> connection;
+		std::string id;
+		bool memory = false;	//Shared memory instead of a file
+		BatchJob file;
+		std::string memoryName;
+		int width = 0;
+		int height = 0;
+		Format format = Format::Grayscale;
+		BatchVariant variant;
+		Settings settings;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	//Parses a non negative integer, the whole text has to be a number
+	static bool ParseNumber(const std::string &text, unsigned long &value)
+	{
+		char *end;
+		value = strtoul(text.c_str(), &end, 10);
+		return !text.empty() && text[0] != '-' && *end == '\0';
+	}
+
+	//Reads a dither or memory request, returns the error or nullptr
+	static const char *ParseJob(const std::vector<std::string> &fields, DaemonJob &job)
+	{
+		if (fields.size() < 4)
+			return "missing fields";
+		job.memory = fields[0] == "memory";
+		if (job.memory)
+		{
+			int channels = 0;
+			char end;
+			job.memoryName = fields[2];
+			if (sscanf(fields[3].c_str(), "%dx%dx%d%c", &job.width, &job.height, &channels, &end) != 3 || job.width <= 0 || job.height <= 0 ||
+				(channels != 1 && channels != 3 && channels != 4))
+				return "invalid size, expected <width>x<height>x<1, 3 or 4>";
+			job.format = (Format)channels;
+		}
+		else
+			job.file = {fields[2], {fields[3]}};
+
+		ManifestVariant variant;
+		variant.variant = job.variant;
+		for (size_t i = 4; i < fields.size(); i++)
+		{
+			size_t equals = fields[i].find('=');
+			if (equals == std::string::npos || equals + 1 == fields[i].size())
+				return "invalid setting";
+			std::string key = fields[i].substr(0, equals);
+			std::string value = fields[i].substr(equals + 1);
+			unsigned long number;
+			if (key == "seed" || key == "serpentine" || key == "linear" || key == "threads")
+			{
+				if (!ParseNumber(value, number))
+					return "invalid setting";
+				if (key == "seed")
+					job.settings.seed = (unsigned int)number;
+				else if (key == "serpentine")
+					job.settings.serpentine = number != 0;
+				else if (key == "linear")
+					job.settings.linear = number != 0;
+				else
+					job.settings.threadCount = (int)number;
+			}
+			//The output path gives the format
+			else if (key == "format" || key == "suffix" || !SetManifestValue(variant, key, value))
+				return "invalid setting";
+		}
+		job.variant = variant.variant;
+		if (job.memory && (job.variant.resizeWidth > 0 || job.variant.resizeHeight > 0))
+			return "shared memory is dithered in place, it can't be resized";
+		return nullptr;
+	}
+
+	//Maps a shared memory object and dithers it in place, returns the error or nullptr
+	static const char *DitherMemory(const DaemonJob &job)
+	{
+		int memory = shm_open(job.memoryName.c_str(), O_RDWR, 0);
+		if (memory < 0)
+			return "can't open the shared memory";
+		size_t size = (size_t)job.width * job.height * (int)job.format;
+		struct stat info;
+		void *data = MAP_FAILED;
+		if (fstat(memory, &info) == 0 && (size_t)info.st_size >= size)
+			data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+		close(memory);
+		if (data == MAP_FAILED)
+			return "the shared memory is smaller than the image";
+
+		PixelBuffer buffer = {(byte *)data, job.width, job.height, job.width * (int)job.format, job.format};
+		Settings settings = job.settings;
+		Palette palette;
+		if (job.variant.palette.IsSet())
+		{
+			//Extracted palettes of grayscale results are made from the gray levels (like the batch)
+			if (job.variant.palette.extractCount > 0 && !job.variant.colored && job.format != Format::Grayscale)
+			{
+				std::vector<byte> pixels((size_t)job.width * job.height);
+				PixelBuffer gray = {pixels.data(), job.width, job.height, job.width, Format::Grayscale};
+				ConvertToGrayscale(buffer, gray, settings.linear);
+				palette = MakePalette(job.variant.palette, gray);
+			}
+			else
+				palette = MakePalette(job.variant.palette, buffer);
+			settings.palette = &palette;
+		}
+		bool finished = Dither(buffer.data, buffer.width, buffer.height, buffer.stride, buffer.format, job.variant.algorithm, job.variant.colored, settings);
+		munmap(data, size);
+		return finished ? nullptr : "can't dither the image";
+	}
+
+	//Runs a job with the buffers of its worker and answers it
+	static void RunJob(const DaemonJob &job, const DaemonOptions &options, BatchArena &arena)
+	{
+		const char *error = nullptr;
+		int width = job.width;
+		int height = job.height;
+		if (job.memory)
+			error = DitherMemory(job);
+		else
+		{
+			BatchOptions batch;
+			batch.variants = {job.variant};
+			batch.settings = job.settings;
+			batch.stripRows = options.stripRows;
+			batch.mapFiles = options.mapFiles;
+			batch.raw = options.raw;
+			ProcessBatchJob(job.file, batch, MakeBatchPalettes(batch), arena, [&](const BatchFileStatus &status)
+			{
+				error = status.error;
+				width = status.width;
+				height = status.height;
+			});
+		}
+
+		long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - job.start).count();
+		if (error != nullptr)
+			job.connection->Reply("error\t" + job.id + "\t" + error);
+		else
+			job.connection->Reply("ok\t" + job.id + "\t" + std::to_string(width) + "x" + std::to_string(height) + "\t" + std::to_string(microseconds));
+	}
+
+	//Dithers a small image with every algorithm in every format, in sRGB and in linear light, so the thread pool is started and the
+	//threshold tables (of both), the luminance and sRGB tables and the instruction set are ready before the first request
+	static void WarmUp(const Settings &options)
+	{
+		constexpr int size = 64;
+		std::vector<byte> pixels(size * size * 4);
+		Settings settings = options;
+		for (bool linear : {false, true})
+		{
+			settings.linear = linear;
+			for (Format format : {Format::Grayscale, Format::R8G8B8, Format::R8G8B8A8})
+			{
+				for (int algorithm = 0; algorithm < Kernels::GetAlgorithmCount(); algorithm++)
+				{
+					for (size_t i = 0; i < pixels.size(); i++)
+						pixels[i] = (byte)(i * 37);
+					Dither(pixels.data(), size, size, size * (int)format, format, algorithm, true, settings);
+				}
+			}
+		}
+	}
+
+	//Write end is used by StopDaemon, the accept loop waits for the read end too
+	static int stopPipe[2] = {-1, -1};
+
+	void StopDaemon()
+	{
+		if (stopPipe[1] >= 0)
+		{
+			ssize_t written = write(stopPipe[1], "s", 1);
+			(void)written;
+		}
+	}
+
+	//Threads that read the requests of a connection and write its replies
+	struct DaemonReader
+	{
+		std::thread thread;
+		std::weak_ptr<DaemonConnection> connection;
+		std::shared_ptr<std::atomic<bool>> finished;
+		std::thread writer;
+		std::shared_ptr<ReplyQueue> replies;
+	};
+
+	bool RunDaemon(const char *socketPath, const DaemonOptions &options, std::string &error)
+	{
+		sockaddr_un address;
+		if (!GetSocketAddress(socketPath, address))
+		{
+			error = std::string("the socket path is too long: ") + socketPath;
+			return false;
+		}
+
+		//A socket file that nobody listens on is left by a daemon that is gone, other files are never removed
+		struct stat info;
+		if (lstat(socketPath, &info) == 0)
+		{
+			int running = ConnectSocket(socketPath);
+			if (running >= 0)
+			{
+				close(running);
+				error = std::string("a daemon already listens on ") + socketPath;
+				return false;
+			}
+			if (!S_ISSOCK(info.st_mode) || unlink(socketPath) != 0)
+			{
+				error = std::string("can't replace ") + socketPath;
+				return false;
+			}
+		}
+
+		//Clients can write any file the daemon can and stop it, so only the user of the daemon can connect
+		//The mode is set before listening, nobody can connect before that
+		int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool bound = listener >= 0 && bind(listener, (const sockaddr *)&address, sizeof(address)) == 0;
+		if (!bound || chmod(socketPath, S_IRUSR | S_IWUSR) != 0 || listen(listener, SOMAXCONN) != 0)
+		{
+			error = std::string("can't listen on ") + socketPath + ": " + strerror(errno);
+			if (listener >= 0)
+				close(listener);
+			if (bound)
+				unlink(socketPath);
+			return false;
+		}
+		if (pipe(stopPipe) != 0)
+		{
+			error = "can't create the stop pipe";
+			close(listener);
+			unlink(socketPath);
+			return false;
+		}
+
+		WarmUp(options.settings);
+
+		//Every worker keeps its arena, so the images of later jobs reuse the memory of the earlier ones
+		int workerCount = options.workers > 0 ? options.workers : GetThreadCount(0);
+		BoundedQueue<DaemonJob> jobs(workerCount * 4);
+		std::vector<std::thread> workers;
+		for (int i = 0; i < workerCount; i++)
+		{
+			workers.emplace_back([&]
+			{
+				BatchArena arena;
+				DaemonJob job;
+				while (jobs.Pop(job))
+				{
+					RunJob(job, options, arena);
+					job = DaemonJob();
+				}
+			});
+		}
+
+		std::vector<DaemonReader> readers;
+		auto readRequests = [&](std::shared_ptr<DaemonConnection> connection, std::shared_ptr<std::atomic<bool>> finished)
+		{
+			std::string received;
+			std::string line;
+			while (ReceiveLine(connection->GetSocket(), received, line))
+			{
+				std::vector<std::string> fields = SplitDaemonFields(line);
+				if (fields[0] == "shutdown")
+				{
+					StopDaemon();
+					break;
+				}
+				if (fields.size() < 2)
+				{
+					connection->Reply("error\t\tmissing id");
+					continue;
+				}
+				if (fields[0] == "ping")
+				{
+					connection->Reply("ok\t" + fields[1]);
+					continue;
+				}
+
+				DaemonJob job;
+				job.start = std::chrono::steady_clock::now();
+				job.connection = connection;
+				job.id = fields[1];
+				job.settings = options.settings;
+				const char *jobError = fields[0] == "dither" || fields[0] == "memory" ? ParseJob(fields, job) : "unknown request";
+				if (jobError != nullptr)
+					connection->Reply("error\t" + job.id + "\t" + jobError);
+				else if (!jobs.Push(std::move(job)))
+					connection->Reply("error\t" + fields[1] + "\tthe daemon is stopping");
+			}
+			*finished = true;
+		};
+
+		pollfd waits[2] = {{listener, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+		while (true)
+		{
+			if (poll(waits, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (waits[1].revents != 0)
+				break;
+			if ((waits[0].revents & POLLIN) == 0)
+				continue;
+			int client = accept(listener, nullptr, nullptr);
+			if (client < 0)
+				continue;
+#ifdef SO_NOSIGPIPE
+			int on = 1;
+			setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+			timeval timeout = {replyTimeoutSeconds, 0};
+			setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+			//Threads of closed connections are joined as new ones come
+			for (size_t i = 0; i < readers.size();)
+			{
+				if (*readers[i].finished && readers[i].replies->finished)
+				{
+					readers[i].thread.join();
+					readers[i].writer.join();
+					readers.erase(readers.begin() + i);
+				}
+				else
+					i++;
+			}
+			auto replies = std::make_shared<ReplyQueue>();
+			auto connection = std::make_shared<DaemonConnection>(client, replies);
+			auto finished = std::make_shared<std::atomic<bool>>(false);
+			std::thread writer(WriteReplies, client, replies);
+			readers.push_back({std::thread(readRequests, connection, finished), connection, finished, std::move(writer), replies});
+		}
+
+		//No new connections, the readers stop reading and the workers finish the jobs they were given
+		close(listener);
+		unlink(socketPath);
+		for (DaemonReader &reader : readers)
+		{
+			if (std::shared_ptr<DaemonConnection> connection = reader.connection.lock())
+				shutdown(connection->GetSocket(), SHUT_RD);
+		}
+		for (DaemonReader &reader : readers)
+			reader.thread.join();
+		jobs.Close();
+		for (std::thread &worker : workers)
+			worker.join();
+		//The connections are gone with their last jobs, their threads send the replies that are left
+		for (DaemonReader &reader : readers)
+			reader.writer.join();
+
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+		stopPipe[0] = stopPipe[1] = -1;
+		return true;
+	}
+
+	DaemonClient::~DaemonClient()
+	{
+		Close();
+	}
+
+	bool DaemonClient::Connect(const char *socketPath)
+	{
+		Close();
+		socket = ConnectSocket(socketPath);
+		return socket >= 0;
+	}
+
+	bool DaemonClient::Send(const std::string &request)
+	{
+		return socket >= 0 && SendAll(socket, request + "\n");
+	}
+
+	bool DaemonClient::Receive(std::string &reply)
+	{
+		return socket >= 0 && ReceiveLine(socket, received, reply);
+	}
+
+	void DaemonClient::Close()
+	{
+		if (socket >= 0)
+			close(socket);
+		socket = -1;
+		received.clear();
+	}
+#endif
+}
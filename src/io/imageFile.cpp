@@ -0,0 +1,351 @@
+#include "imageFile.h"
+#include "dither.h"
+#include "netpbm.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <functional>
+#include <initializer_list>
+
+//Private copies of stb_image and stb_image_write, so they don't clash with the ones in raylib
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_NO_HDR
+#define STBI_NO_LINEAR
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include <stb_image.h>
+#include <stb_image_write.h>
+#pragma GCC diagnostic pop
+
+namespace Dithering
+{
+	//Extension of the path including the dot, an empty string when there is none
+	static const char *GetExtension(const char *path)
+	{
+		const char *dot = strrchr(path, '.');
+		const char *slash = strrchr(path, '/');
+		if (dot == nullptr || (slash != nullptr && slash > dot))
+			return "";
+		return dot;
+	}
+
+	//Pam files aren't read by stb_image
+	static bool LoadPam(const char *path, ImageFile &image)
+	{
+		NetpbmReader reader;
+		if (!reader.Open(path))
+			return false;
+		image.width = reader.GetWidth();
+		image.height = reader.GetHeight();
+		image.format = reader.GetFormat();
+		image.pixels.resize((size_t)image.width * image.height * (int)image.format);
+		PixelBuffer buffer = image.GetBuffer();
+		return reader.ReadRows(buffer);
+	}
+
+	static bool Load(const char *path, int channels, ImageFile &image)
+	{
+		DITHER_TIME(Stage::Load, 0.0);
+		if (strcasecmp(GetExtension(path), ".pam") == 0)
+		{
+			if (!LoadPam(path, image))
+				return false;
+			if (channels == 0 || channels == (int)image.format)
+				return true;
+
+			//Gray is the luminance used everywhere else in the library, color gets opaque alpha
+			ImageFile converted;
+			converted.width = image.width;
+			converted.height = image.height;
+			converted.format = (Format)channels;
+			converted.pixels.resize((size_t)image.width * image.height * channels);
+			PixelBuffer source = image.GetBuffer();
+			PixelBuffer destination = converted.GetBuffer();
+			if (channels == 1)
+				ConvertToGrayscale(source, destination);
+			else
+			{
+				for (size_t i = 0; i < (size_t)image.width * image.height; i++)
+				{
+					const byte *pixel = image.pixels.data() + i * (int)image.format;
+					byte *output = converted.pixels.data() + i * channels;
+					for (int c = 0; c < 3; c++)
+						output[c] = pixel[image.format == Format::Grayscale ? 0 : c];
+					if (channels == 4)
+						output[3] = image.format == Format::R8G8B8A8 ? pixel[3] : 255;
+				}
+			}
+			image = std::move(converted);
+			return true;
+		}
+
+		int width, height, fileChannels;
+		if (channels == 0)
+		{
+			if (!stbi_info(path, &width, &height, &fileChannels))
+				return false;
+			//Gray with alpha has no format of its own, alpha is kept in RGBA
+			channels = fileChannels == 2 ? 4 : fileChannels;
+		}
+
+		byte *data = stbi_load(path, &width, &height, &fileChannels, channels);
+		if (data == nullptr)
+			return false;
+
+		image.width = width;
+		image.height = height;
+		image.format = (Format)channels;
+		image.pixels.assign(data, data + (size_t)width * height * channels);
+		stbi_image_free(data);
+		return true;
+	}
+
+	bool LoadImageFile(const char *path, ImageFile &image)
+	{
+		return Load(path, 0, image);
+	}
+
+	bool LoadImageFile(const char *path, Format format, ImageFile &image)
+	{
+		return Load(path, (int)format, image);
+	}
+
+	//Table of the CRC-32 of PNG chunks (reversed polynomial 0xEDB88320)
+	struct CrcTable
+	{
+		uint32_t values[256];
+
+		constexpr CrcTable() : values()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t crc = i;
+				for (int bit = 0; bit < 8; bit++)
+					crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+				values[i] = crc;
+			}
+		}
+	};
+	static constexpr CrcTable crcTable;
+
+	static uint32_t UpdateCrc(uint32_t crc, const byte *data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			crc = crcTable.values[(crc ^ data[i]) & 255] ^ (crc >> 8);
+		return crc;
+	}
+
+	static void PutBigEndian(byte *destination, uint32_t value)
+	{
+		destination[0] = (byte)(value >> 24);
+		destination[1] = (byte)(value >> 16);
+		destination[2] = (byte)(value >> 8);
+		destination[3] = (byte)value;
+	}
+
+	//Writes a PNG chunk: length, type, data and the CRC of the type and the data
+	static bool WriteChunk(FILE *file, const char *type, const byte *data, size_t size)
+	{
+		byte header[8];
+		PutBigEndian(header, (uint32_t)size);
+		memcpy(header + 4, type, 4);
+		byte crc[4];
+		PutBigEndian(crc, ~UpdateCrc(UpdateCrc(0xFFFFFFFFu, header + 4, 4), data, size));
+		return fwrite(header, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(crc, 1, 4, file) == 4;
+	}
+
+	//Whether color i of the image is the gray level i of its bit depth, then the indices can be saved as a grayscale PNG
+	static bool IsGrayRamp(const PackedImage &image)
+	{
+		int maximum = (1 << image.bitsPerPixel) - 1;
+		for (int i = 0; i < (int)image.colors.size(); i++)
+		{
+			int level = i * 255 / maximum;
+			const Color &color = image.colors[i];
+			if (color.r != level || color.g != level || color.b != level)
+				return false;
+		}
+		return true;
+	}
+
+	//Grayscale or paletted PNG with the bit depth of the packed image, rows use no filter (dithered pixels don't predict well)
+	static bool SavePackedPng(const char *path, const PackedImage &image)
+	{
+		std::vector<byte> filtered((size_t)(image.stride + 1) * image.height);
+		for (int y = 0; y < image.height; y++)
+		{
+			filtered[(size_t)y * (image.stride + 1)] = 0;
+			memcpy(filtered.data() + (size_t)y * (image.stride + 1) + 1, image.data.data() + (size_t)y * image.stride, image.stride);
+		}
+		int compressedSize;
+		byte *compressed = stbi_zlib_compress(filtered.data(), (int)filtered.size(), &compressedSize, 8);
+		if (compressed == nullptr)
+			return false;
+
+		bool gray = IsGrayRamp(image);
+		byte header[13];
+		PutBigEndian(header, image.width);
+		PutBigEndian(header + 4, image.height);
+		header[8] = (byte)image.bitsPerPixel;
+		header[9] = gray ? 0 : 3;
+		header[10] = header[11] = header[12] = 0;
+
+		std::vector<byte> palette;
+		for (const Color &color : image.colors)
+			palette.insert(palette.end(), {color.r, color.g, color.b});
+
+		static const byte signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+		FILE *file = fopen(path, "wb");
+		bool saved = file != nullptr && fwrite(signature, 1, 8, file) == 8 && WriteChunk(file, "IHDR", header, sizeof(header)) &&
+					 (gray || WriteChunk(file, "PLTE", palette.data(), palette.size())) &&
+					 WriteChunk(file, "IDAT", compressed, compressedSize) && WriteChunk(file, "IEND", nullptr, 0);
+		if (file != nullptr)
+			saved = fclose(file) == 0 && saved;
+		free(compressed);
+		return saved;
+	}
+
+	//Binary netpbm file (P4 for pbm, P5 for pgm and P6 for ppm), getRow gives the bytes of every row in order
+	static bool SaveNetpbm(const char *path, int magic, int width, int height, size_t rowSize, const std::function<const byte *(int, byte *)> &getRow)
+	{
+		FILE *file = fopen(path, "wb");
+		if (file == nullptr)
+			return false;
+
+		bool saved = fprintf(file, "P%d\n%d %d\n%s", magic, width, height, magic == 4 ? "" : "255\n") > 0;
+		std::vector<byte> row(rowSize);
+		for (int y = 0; y < height && saved; y++)
+			saved = fwrite(getRow(y, row.data()), 1, rowSize, file) == rowSize;
+		return fclose(file) == 0 && saved;
+	}
+
+	bool SavePackedImageFile(const char *path, const PackedImage &image)
+	{
+		DITHER_TIME(Stage::Save, (double)image.width * image.height / 1e6);
+		const char *extension = GetExtension(path);
+		if (strcasecmp(extension, ".png") == 0)
+			return SavePackedPng(path, image);
+
+		if (strcasecmp(extension, ".raw") == 0)
+		{
+			FILE *file = fopen(path, "wb");
+			if (file == nullptr)
+				return false;
+			bool saved = fwrite(image.data.data(), 1, image.data.size(), file) == image.data.size();
+			return fclose(file) == 0 && saved;
+		}
+
+		if (strcasecmp(extension, ".pbm") == 0)
+		{
+			//Only black and white, a set bit is black (colors are sorted, so black is always the first one)
+			if (image.bitsPerPixel != 1)
+				return false;
+			for (const Color &color : image.colors)
+			{
+				if ((color.r != 0 || color.g != 0 || color.b != 0) && (color.r != 255 || color.g != 255 || color.b != 255))
+					return false;
+			}
+			bool invert = image.colors[0].r == 0;
+			return SaveNetpbm(path, 4, image.width, image.height, image.stride, [&](int y, byte *row)
+			{
+				const byte *source = image.data.data() + (size_t)y * image.stride;
+				if (!invert)
+					return source;
+				for (int i = 0; i < image.stride; i++)
+					row[i] = (byte)~source[i];
+				return (const byte *)row;
+			});
+		}
+
+		//The other netpbm files get the colors a row at a time, the writer converts them to its format
+		if (!IsNetpbmOutput(path))
+			return false;
+		Format format = image.gray ? Format::Grayscale : Format::R8G8B8;
+		NetpbmWriter writer;
+		if (!writer.Open(path, image.width, image.height, format))
+			return false;
+		std::vector<byte> row((size_t)image.width * (int)format);
+		PixelBuffer rowBuffer{row.data(), image.width, 1, (int)row.size(), format};
+		for (int y = 0; y < image.height; y++)
+		{
+			for (int x = 0; x < image.width; x++)
+			{
+				const Color &color = image.colors[image.GetIndex(x, y)];
+				if (image.gray)
+					row[x] = color.r;
+				else
+				{
+					row[x * 3] = color.r;
+					row[x * 3 + 1] = color.g;
+					row[x * 3 + 2] = color.b;
+				}
+			}
+			if (!writer.WriteRows(rowBuffer))
+				return false;
+		}
+		return writer.Close();
+	}
+
+	bool SaveImageFile(const char *path, const PixelBuffer &buffer)
+	{
+		const char *extension = GetExtension(path);
+		int channels = (int)buffer.format;
+
+		//Dithered images are saved with their indices, pbm and raw files can't hold anything else
+		bool packedOnly = strcasecmp(extension, ".pbm") == 0 || strcasecmp(extension, ".raw") == 0;
+		if (packedOnly || strcasecmp(extension, ".png") == 0)
+		{
+			PackedImage packed;
+			if (PackImage(buffer, packed))
+				return SavePackedImageFile(path, packed);
+			if (packedOnly)
+				return false;
+		}
+		//Packed images are timed by SavePackedImageFile
+		DITHER_TIME(Stage::Save, (double)buffer.width * buffer.height / 1e6);
+		//Other netpbm files take any pixels (pgm converts color to gray, ppm repeats gray in the chanels and pam keeps the format)
+		if (IsNetpbmOutput(path))
+		{
+			NetpbmWriter writer;
+			return writer.Open(path, buffer.width, buffer.height, buffer.format) && writer.WriteRows(buffer) && writer.Close();
+		}
+
+		//Only png takes a stride, the other writers need tightly packed rows
+		const byte *data = buffer.data;
+		std::vector<byte> packed;
+		if (buffer.stride != buffer.width * channels && strcasecmp(extension, ".png") != 0)
+		{
+			packed.resize((size_t)buffer.width * buffer.height * channels);
+			for (int y = 0; y < buffer.height; y++)
+				memcpy(packed.data() + (size_t)y * buffer.width * channels, buffer.data + (long long)y * buffer.stride, (size_t)buffer.width * channels);
+			data = packed.data();
+		}
+
+		if (strcasecmp(extension, ".png") == 0)
+			return stbi_write_png(path, buffer.width, buffer.height, channels, data, buffer.stride) != 0;
+		if (strcasecmp(extension, ".bmp") == 0)
+			return stbi_write_bmp(path, buffer.width, buffer.height, channels, data) != 0;
+		if (strcasecmp(extension, ".tga") == 0)
+			return stbi_write_tga(path, buffer.width, buffer.height, channels, data) != 0;
+		if (strcasecmp(extension, ".jpg") == 0 || strcasecmp(extension, ".jpeg") == 0)
+			return stbi_write_jpg(path, buffer.width, buffer.height, channels, data, 90) != 0;
+		return false;
+	}
+
+	bool IsSupportedOutput(const char *path)
+	{
+		const char *extension = GetExtension(path);
+		for (const char *supported : {".png", ".bmp", ".tga", ".jpg", ".jpeg", ".pbm", ".pgm", ".ppm", ".pam", ".raw"})
+		{
+			if (strcasecmp(extension, supported) == 0)
+				return true;
+		}
+		return false;
+	}
+}
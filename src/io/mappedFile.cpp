@@ -0,0 +1,121 @@
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Dithering
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+#ifdef _WIN32
+	bool MappedFile::OpenRead(const char *path)
+	{
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			return false;
+		size = (size_t)fileSize.QuadPart;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+			return false;
+		data = (byte *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		return data != nullptr;
+	}
+
+	bool MappedFile::Create(const char *path, size_t size)
+	{
+		file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			return false;
+		}
+		this->size = size;
+
+		//The mapping sets the size of the file
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, nullptr);
+		if (mapping == nullptr)
+			return false;
+		data = (byte *)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+		return data != nullptr;
+	}
+
+	bool MappedFile::Close()
+	{
+		bool closed = true;
+		if (data != nullptr)
+			closed = UnmapViewOfFile(data) != 0;
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		if (file != nullptr)
+			closed = CloseHandle(file) != 0 && closed;
+		data = nullptr;
+		mapping = nullptr;
+		file = nullptr;
+		size = 0;
+		return closed;
+	}
+#else
+	bool MappedFile::OpenRead(const char *path)
+	{
+		file = open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat status;
+		if (fstat(file, &status) != 0 || status.st_size == 0)
+			return false;
+		size = (size_t)status.st_size;
+
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+		if (mapped == MAP_FAILED)
+			return false;
+		data = (byte *)mapped;
+		//Rows are read from the top, so the kernel can read ahead
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		return true;
+	}
+
+	bool MappedFile::Create(const char *path, size_t size)
+	{
+		file = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (file < 0 || ftruncate(file, (off_t)size) != 0)
+			return false;
+		this->size = size;
+
+		void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if (mapped == MAP_FAILED)
+			return false;
+		data = (byte *)mapped;
+		return true;
+	}
+
+	bool MappedFile::Close()
+	{
+		bool closed = true;
+		if (data != nullptr)
+			closed = munmap(data, size) == 0;
+		if (file >= 0)
+			closed = close(file) == 0 && closed;
+		data = nullptr;
+		file = -1;
+		size = 0;
+		return closed;
+	}
+#endif
+}
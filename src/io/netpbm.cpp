@@ -0,0 +1,314 @@
+#include "netpbm.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <initializer_list>
+#include <string>
+
+namespace Dithering
+{
+	//Big buffers for the files, strips are read and written with few system calls
+	constexpr size_t fileBufferSize = 1 << 20;
+
+	static bool HasExtension(const char *path, std::initializer_list<const char *> extensions)
+	{
+		const char *dot = strrchr(path, '.');
+		const char *slash = strrchr(path, '/');
+		if (dot == nullptr || (slash != nullptr && slash > dot))
+			return false;
+		for (const char *extension : extensions)
+		{
+			if (strcasecmp(dot, extension) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	bool IsNetpbmInput(const char *path)
+	{
+		return HasExtension(path, {".pgm", ".ppm", ".pnm", ".pam"});
+	}
+
+	bool IsNetpbmOutput(const char *path)
+	{
+		return HasExtension(path, {".pbm", ".pgm", ".ppm", ".pam"});
+	}
+
+	//Header bytes of a file
+	struct FileInput
+	{
+		FILE *file;
+
+		int Next() { return fgetc(file); }
+	};
+
+	//Header bytes of a file in memory
+	struct MemoryInput
+	{
+		const byte *data;
+		size_t size;
+		size_t position;
+
+		int Next() { return position < size ? data[position++] : EOF; }
+	};
+
+	//Reads a header token, whitespace and comments (# to the end of the line) before it are skipped
+	template<typename Input>
+	static bool ReadToken(Input &input, char *token, int size)
+	{
+		int c = input.Next();
+		while (c == '#' || isspace(c))
+		{
+			if (c == '#')
+			{
+				while (c != '\n' && c != EOF)
+					c = input.Next();
+			}
+			c = input.Next();
+		}
+
+		int length = 0;
+		while (c != EOF && !isspace(c) && length < size - 1)
+		{
+			token[length++] = (char)c;
+			c = input.Next();
+		}
+		token[length] = '\0';
+		//The single whitespace after the last header value is consumed here, the pixels start right after it
+		return length > 0;
+	}
+
+	template<typename Input>
+	static bool ReadNumber(Input &input, int &value)
+	{
+		char token[32];
+		if (!ReadToken(input, token, sizeof(token)))
+			return false;
+		char *end;
+		long number = strtol(token, &end, 10);
+		if (*end != '\0' || number <= 0 || number > 0x7FFFFFFF)
+			return false;
+		value = (int)number;
+		return true;
+	}
+
+	//Reads the header of a binary pgm (P5), ppm (P6) or pam (P7 with a depth of 1, 3 or 4) with a maximum value of 255
+	template<typename Input>
+	static bool ReadHeader(Input &input, int &width, int &height, Format &format)
+	{
+		char magic[4];
+		if (!ReadToken(input, magic, sizeof(magic)))
+			return false;
+
+		int maximum = 0;
+		if (strcmp(magic, "P5") == 0 || strcmp(magic, "P6") == 0)
+		{
+			format = magic[1] == '5' ? Format::Grayscale : Format::R8G8B8;
+			if (!ReadNumber(input, width) || !ReadNumber(input, height) || !ReadNumber(input, maximum))
+				return false;
+		}
+		else if (strcmp(magic, "P7") == 0)
+		{
+			//Pam headers are lines of a name and a value, the tuple type isn't needed because the depth gives the format
+			int depth = 0;
+			char name[16];
+			char value[64];
+			while (ReadToken(input, name, sizeof(name)) && strcmp(name, "ENDHDR") != 0)
+			{
+				if (strcmp(name, "TUPLTYPE") == 0)
+				{
+					if (!ReadToken(input, value, sizeof(value)))
+						return false;
+					continue;
+				}
+				int *field = strcmp(name, "WIDTH") == 0 ? &width : strcmp(name, "HEIGHT") == 0 ? &height :
+							 strcmp(name, "DEPTH") == 0 ? &depth : strcmp(name, "MAXVAL") == 0 ? &maximum : nullptr;
+				if (field == nullptr || !ReadNumber(input, *field))
+					return false;
+			}
+			if (depth != 1 && depth != 3 && depth != 4)
+				return false;
+			format = (Format)depth;
+		}
+		else
+			return false;
+
+		return width > 0 && height > 0 && maximum == 255;
+	}
+
+	bool ParseNetpbmHeader(const byte *data, size_t size, int &width, int &height, Format &format, size_t &offset)
+	{
+		MemoryInput input = {data, size, 0};
+		if (!ReadHeader(input, width, height, format))
+			return false;
+		offset = input.position;
+		return (size - offset) / ((size_t)width * (int)format) >= (size_t)height;
+	}
+
+	//Header of a netpbm file, pam keeps the format of the rows
+	static std::string GetHeader(NetpbmType type, int width, int height, Format format)
+	{
+		static const char *tupleTypes[] = {"", "GRAYSCALE", "", "RGB", "RGB_ALPHA"};
+		char header[128];
+		switch (type)
+		{
+			case NetpbmType::Bitmap:
+				snprintf(header, sizeof(header), "P4\n%d %d\n", width, height);
+				break;
+			case NetpbmType::Graymap:
+				snprintf(header, sizeof(header), "P5\n%d %d\n255\n", width, height);
+				break;
+			case NetpbmType::Pixmap:
+				snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+				break;
+			default:
+				snprintf(header, sizeof(header), "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n", width, height, (int)format,
+						 tupleTypes[(int)format]);
+				break;
+		}
+		return header;
+	}
+
+	static NetpbmType GetType(const char *path)
+	{
+		return HasExtension(path, {".pbm"}) ? NetpbmType::Bitmap : HasExtension(path, {".pgm"}) ? NetpbmType::Graymap :
+			   HasExtension(path, {".ppm"}) ? NetpbmType::Pixmap : NetpbmType::ArbitraryMap;
+	}
+
+	std::string GetNetpbmHeader(const char *path, int width, int height, Format format)
+	{
+		NetpbmType type = GetType(path);
+		if (!IsNetpbmOutput(path) || type == NetpbmType::Bitmap || (type == NetpbmType::Graymap && format != Format::Grayscale) ||
+			(type == NetpbmType::Pixmap && format != Format::R8G8B8))
+			return "";
+		return GetHeader(type, width, height, format);
+	}
+
+	NetpbmReader::~NetpbmReader()
+	{
+		if (file != nullptr)
+			fclose(file);
+	}
+
+	bool NetpbmReader::Open(const char *path)
+	{
+		file = fopen(path, "rb");
+		if (file == nullptr)
+			return false;
+		setvbuf(file, nullptr, _IOFBF, fileBufferSize);
+
+		FileInput input = {file};
+		return ReadHeader(input, width, height, format);
+	}
+
+	bool NetpbmReader::ReadRows(PixelBuffer &strip)
+	{
+		size_t rowSize = (size_t)width * (int)format;
+		if (file == nullptr || strip.format != format || strip.width != width)
+			return false;
+		if (strip.stride == (int)rowSize)
+			return fread(strip.data, 1, rowSize * strip.height, file) == rowSize * strip.height;
+		for (int y = 0; y < strip.height; y++)
+		{
+			if (fread(strip.data + (long long)y * strip.stride, 1, rowSize, file) != rowSize)
+				return false;
+		}
+		return true;
+	}
+
+	NetpbmWriter::~NetpbmWriter()
+	{
+		Close();
+	}
+
+	bool NetpbmWriter::Open(const char *path, int width, int height, Format format)
+	{
+		type = GetType(path);
+		this->width = width;
+		this->format = format;
+		failed = false;
+
+		file = fopen(path, "wb");
+		if (file == nullptr)
+			return false;
+		setvbuf(file, nullptr, _IOFBF, fileBufferSize);
+
+		switch (type)
+		{
+			case NetpbmType::Bitmap:
+				row.resize((width + 7) / 8);
+				break;
+			case NetpbmType::Graymap:
+				row.resize(width);
+				break;
+			case NetpbmType::Pixmap:
+				row.resize((size_t)width * 3);
+				break;
+			default:
+				break;
+		}
+		std::string header = GetHeader(type, width, height, format);
+		failed = fwrite(header.data(), 1, header.size(), file) != header.size();
+		return !failed;
+	}
+
+	bool NetpbmWriter::WriteRows(const PixelBuffer &strip)
+	{
+		if (file == nullptr || failed)
+			return false;
+
+		int channels = (int)format;
+		for (int y = 0; y < strip.height && !failed; y++)
+		{
+			const byte *source = strip.data + (long long)y * strip.stride;
+			const byte *output = row.data();
+			switch (type)
+			{
+				case NetpbmType::Bitmap:
+					//A set bit is black, only the first chanel of color pixels is looked at (dithered gray has the same value in all of them)
+					memset(row.data(), 0, row.size());
+					for (int x = 0; x < width; x++)
+					{
+						if (source[x * channels] < 128)
+							row[x >> 3] |= (byte)(0x80 >> (x & 7));
+					}
+					break;
+				case NetpbmType::Graymap:
+					ConvertRowToGrayscale(source, format, row.data(), width);
+					break;
+				case NetpbmType::Pixmap:
+					//Gray is repeated in the chanels and alpha is dropped
+					if (format == Format::R8G8B8)
+					{
+						output = source;
+						break;
+					}
+					for (int x = 0; x < width; x++)
+					{
+						const byte *pixel = source + x * channels;
+						row[x * 3] = pixel[0];
+						row[x * 3 + 1] = channels == 1 ? pixel[0] : pixel[1];
+						row[x * 3 + 2] = channels == 1 ? pixel[0] : pixel[2];
+					}
+					break;
+				default:
+					output = source;
+					break;
+			}
+			size_t size = type == NetpbmType::ArbitraryMap ? (size_t)width * channels : row.size();
+			failed = fwrite(output, 1, size, file) != size;
+		}
+		return !failed;
+	}
+
+	bool NetpbmWriter::Close()
+	{
+		if (file == nullptr)
+			return !failed;
+		failed = fclose(file) != 0 || failed;
+		file = nullptr;
+		return !failed;
+	}
+}
@@ -0,0 +1,298 @@
+//Checks that the ways of running a kernel that should give the same image do: one thread and many, the wavefront and the serial
+//error diffusion, strips of a stream and tiles against the whole image, and every instruction set against the scalar kernels
+//Usage: dither_tests                      Compares the threads, the wavefront, strips and tiles
+//       dither_tests --write <file>       Writes a digest of every case (run with DITHER_ISA=scalar for the reference)
+//       dither_tests --compare <file>     Compares the digests with the ones of --write (run with every DITHER_ISA)
+
+//Standard headers
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//Project specific headers
+#include "dither.h"
+#include "cpu.h"
+#include "palette.h"
+
+using namespace Dithering;
+
+//Odd sizes, so the vector kernels have tails and the tiles and strips don't divide the image
+constexpr int imageWidth = 203;
+constexpr int imageHeight = 67;
+constexpr int stridePadding = 5;
+constexpr int threadCount = 4;
+
+//Synthetic image with gradients and noise, rows are stridePadding bytes longer than the pixels
+struct TestImage
+{
+	Format format;
+	int stride;
+	std::vector<byte> pixels;
+
+	PixelBuffer GetBuffer()
+	{
+		return {pixels.data(), imageWidth, imageHeight, stride, format};
+	}
+};
+
+//One way to dither the image
+struct TestCase
+{
+	std::string name;
+	Format format;
+	int algorithm;
+	bool colored;
+	const Palette *palette;
+	bool linear;
+	bool serpentine;
+};
+
+static TestImage MakeImage(Format format)
+{
+	TestImage image;
+	image.format = format;
+	int bytesPerPixel = (int)format;
+	image.stride = imageWidth * bytesPerPixel + stridePadding;
+	image.pixels.resize((size_t)image.stride * imageHeight);
+	unsigned int noise = 1;
+	for (int y = 0; y < imageHeight; y++)
+	{
+		byte *pixel = image.pixels.data() + (size_t)y * image.stride;
+		for (int x = 0; x < imageWidth; x++, pixel += bytesPerPixel)
+		{
+			noise = noise * 1664525u + 1013904223u;
+			int detail = (int)(noise >> 27) - 16;
+			int values[4] = {x * 255 / imageWidth + detail, y * 255 / imageHeight + detail, (x + y) * 255 / (imageWidth + imageHeight) - detail,
+							 (int)(noise >> 24)};
+			for (int c = 0; c < bytesPerPixel; c++)
+				pixel[c] = (byte)(values[c] < 0 ? 0 : values[c] > 255 ? 255 : values[c]);
+		}
+	}
+	return image;
+}
+
+static const char *FormatName(Format format)
+{
+	switch (format)
+	{
+		case Format::Grayscale:
+			return "gray";
+		case Format::R8G8B8:
+			return "rgb";
+		default:
+			return "rgba";
+	}
+}
+
+//Images are made once in every format, in the order of the formats
+static TestImage &GetSource(std::vector<TestImage> &sources, Format format)
+{
+	return sources[format == Format::Grayscale ? 0 : format == Format::R8G8B8 ? 1 : 2];
+}
+
+//Every algorithm in every format, black and white, colored, with a palette, in linear light and with the serpentine scan
+static std::vector<TestCase> GetTestCases(const Palette &palette)
+{
+	std::vector<TestCase> cases;
+	for (Format format : {Format::Grayscale, Format::R8G8B8, Format::R8G8B8A8})
+	{
+		for (int algorithm = 0; algorithm < Kernels::GetAlgorithmCount(); algorithm++)
+		{
+			std::string name = std::string(FormatName(format)) + " " + Kernels::GetAlgorithms()[algorithm].name;
+			cases.push_back({name, format, algorithm, false, nullptr, false, false});
+			cases.push_back({name + " linear", format, algorithm, false, nullptr, true, false});
+			cases.push_back({name + " palette", format, algorithm, false, &palette, false, false});
+			if (format != Format::Grayscale)
+			{
+				cases.push_back({name + " colored", format, algorithm, true, nullptr, false, false});
+				cases.push_back({name + " colored palette linear", format, algorithm, true, &palette, true, false});
+			}
+			if (!Kernels::GetAlgorithms()[algorithm].pointWise)
+				cases.push_back({name + " serpentine", format, algorithm, format != Format::Grayscale, nullptr, false, true});
+		}
+	}
+	return cases;
+}
+
+static Settings GetSettings(const TestCase &test, int threads, bool wavefront)
+{
+	Settings settings;
+	settings.threadCount = threads;
+	settings.wavefront = wavefront;
+	settings.palette = test.palette;
+	settings.linear = test.linear;
+	settings.serpentine = test.serpentine;
+	return settings;
+}
+
+//Result of dithering the image in place with Dither
+static TestImage DitherImage(const TestCase &test, const TestImage &source, int threads, bool wavefront)
+{
+	TestImage image = source;
+	Dither(image.pixels.data(), imageWidth, imageHeight, image.stride, image.format, test.algorithm, test.colored, GetSettings(test, threads, wavefront));
+	return image;
+}
+
+//Result of dithering the image into a destination of the result format, whole or in strips of stripRows rows
+static TestImage DitherCopy(const TestCase &test, TestImage &source, int stripRows)
+{
+	TestImage image;
+	image.format = test.colored ? source.format : Format::Grayscale;
+	image.stride = imageWidth * (int)image.format + stridePadding;
+	image.pixels.assign((size_t)image.stride * imageHeight, 0);
+	PixelBuffer sourceBuffer = source.GetBuffer();
+	PixelBuffer destination = image.GetBuffer();
+	Settings settings = GetSettings(test, threadCount, true);
+	if (stripRows <= 0)
+	{
+		DitherInto(sourceBuffer, destination, test.algorithm, settings);
+		return image;
+	}
+
+	StreamDitherer stream(imageWidth, image.format, test.algorithm, settings);
+	for (int y = 0; y < imageHeight; y += stripRows)
+	{
+		int rows = y + stripRows < imageHeight ? stripRows : imageHeight - y;
+		PixelBuffer sourceStrip = {sourceBuffer.data + (size_t)y * sourceBuffer.stride, imageWidth, rows, sourceBuffer.stride, sourceBuffer.format};
+		PixelBuffer strip = {destination.data + (size_t)y * destination.stride, imageWidth, rows, destination.stride, destination.format};
+		stream.DitherStripInto(sourceStrip, strip);
+	}
+	return image;
+}
+
+//Result of a point-wise algorithm dithered in tiles, the focus is off center so the tiles come in an odd order
+static TestImage DitherInTiles(const TestCase &test, const TestImage &source)
+{
+	TestImage image = source;
+	PixelBuffer buffer = image.GetBuffer();
+	std::vector<Tile> tiles = GetTiles(imageWidth, imageHeight, 24, {150, 40, 30, 20});
+	DitherTiles(buffer, test.algorithm, tiles, GetSettings(test, threadCount, true), [](const Tile &) {});
+	return image;
+}
+
+//Only the pixels count, the padding of the rows is left as it was
+static bool IsSameImage(const TestImage &a, const TestImage &b)
+{
+	if (a.format != b.format)
+		return false;
+	for (int y = 0; y < imageHeight; y++)
+	{
+		if (memcmp(a.pixels.data() + (size_t)y * a.stride, b.pixels.data() + (size_t)y * b.stride, (size_t)imageWidth * (int)a.format) != 0)
+			return false;
+	}
+	return true;
+}
+
+//FNV-1a of the pixels
+static uint64_t GetDigest(const TestImage &image)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (int y = 0; y < imageHeight; y++)
+	{
+		const byte *row = image.pixels.data() + (size_t)y * image.stride;
+		for (int i = 0; i < imageWidth * (int)image.format; i++)
+			hash = (hash ^ row[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static int CheckConsistency(const std::vector<TestCase> &cases, std::vector<TestImage> &sources)
+{
+	int failed = 0;
+	auto check = [&](const TestCase &test, const char *what, bool same)
+	{
+		if (!same)
+		{
+			fprintf(stderr, "FAIL  %s: %s\n", test.name.c_str(), what);
+			failed++;
+		}
+	};
+
+	for (const TestCase &test : cases)
+	{
+		TestImage &source = GetSource(sources, test.format);
+		TestImage serial = DitherImage(test, source, 1, false);
+		check(test, "wavefront differs from one thread", IsSameImage(serial, DitherImage(test, source, threadCount, true)));
+		check(test, "threads without the wavefront differ from one thread", IsSameImage(serial, DitherImage(test, source, threadCount, false)));
+
+		TestImage whole = DitherCopy(test, source, 0);
+		check(test, "strips of 1 row differ from the whole image", IsSameImage(whole, DitherCopy(test, source, 1)));
+		check(test, "strips of 7 rows differ from the whole image", IsSameImage(whole, DitherCopy(test, source, 7)));
+
+		//Tiles are dithered in place, so the image is already in the result format
+		if (Kernels::GetAlgorithms()[test.algorithm].pointWise && (test.colored || test.format == Format::Grayscale))
+			check(test, "tiles differ from the whole image", IsSameImage(serial, DitherInTiles(test, source)));
+	}
+	printf("%d of %d cases consistent (%s)\n", (int)cases.size() - failed, (int)cases.size(), GetIsaName(GetIsa()));
+	return failed == 0 ? 0 : 1;
+}
+
+static int WriteDigests(const std::vector<TestCase> &cases, std::vector<TestImage> &sources, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Can't open %s\n", path);
+		return 1;
+	}
+	for (const TestCase &test : cases)
+	{
+		TestImage &source = GetSource(sources, test.format);
+		fprintf(file, "%016llx %s\n", (unsigned long long)GetDigest(DitherImage(test, source, 1, false)), test.name.c_str());
+	}
+	fclose(file);
+	printf("%d digests written (%s)\n", (int)cases.size(), GetIsaName(GetIsa()));
+	return 0;
+}
+
+static int CompareDigests(const std::vector<TestCase> &cases, std::vector<TestImage> &sources, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Can't open %s\n", path);
+		return 1;
+	}
+	int failed = 0;
+	char line[256];
+	for (const TestCase &test : cases)
+	{
+		unsigned long long expected = 0;
+		if (fgets(line, sizeof(line), file) == nullptr || sscanf(line, "%llx", &expected) != 1)
+		{
+			fprintf(stderr, "FAIL  %s: no digest in %s\n", test.name.c_str(), path);
+			failed++;
+			continue;
+		}
+		TestImage &source = GetSource(sources, test.format);
+		if (GetDigest(DitherImage(test, source, 1, false)) != expected)
+		{
+			fprintf(stderr, "FAIL  %s: %s differs from the digest\n", test.name.c_str(), GetIsaName(GetIsa()));
+			failed++;
+		}
+	}
+	fclose(file);
+	printf("%d of %d cases match the digests (%s)\n", (int)cases.size() - failed, (int)cases.size(), GetIsaName(GetIsa()));
+	return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	Palette palette({{0, 0, 0}, {29, 43, 83}, {126, 37, 83}, {0, 135, 81}, {171, 82, 54}, {95, 87, 79}, {194, 195, 199}, {255, 241, 232},
+					 {255, 0, 77}, {255, 163, 0}, {255, 236, 39}, {0, 228, 54}, {41, 173, 255}, {131, 118, 156}, {255, 119, 168}, {255, 204, 170}});
+	std::vector<TestCase> cases = GetTestCases(palette);
+	std::vector<TestImage> sources = {MakeImage(Format::Grayscale), MakeImage(Format::R8G8B8), MakeImage(Format::R8G8B8A8)};
+
+	if (argc == 3 && strcmp(argv[1], "--write") == 0)
+		return WriteDigests(cases, sources, argv[2]);
+	if (argc == 3 && strcmp(argv[1], "--compare") == 0)
+		return CompareDigests(cases, sources, argv[2]);
+	if (argc != 1)
+	{
+		fprintf(stderr, "Usage: dither_tests [--write <file> | --compare <file>]\n");
+		return 2;
+	}
+	return CheckConsistency(cases, sources);
+}
@@ -0,0 +1,171 @@
+//Generates the blue noise threshold mask with the void-and-cluster method and writes it as a C++ header
+//Runs at build time, so the dithering itself only reads a table
+//Usage: dither_bluenoise <output header> [size]
+
+//Standard headers
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+//Toroidal gaussian energy of a binary pattern, updated every time a pixel changes
+class EnergyField
+{
+public:
+	EnergyField(int size, double sigma) : size(size), kernel(size * size), energy(size * size, 0.0), pattern(size * size, false)
+	{
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				int dx = x < size / 2 ? x : size - x;
+				int dy = y < size / 2 ? y : size - y;
+				kernel[y * size + x] = exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+			}
+		}
+	}
+
+	void Set(int index, bool value)
+	{
+		if (pattern[index] == value)
+			return;
+		pattern[index] = value;
+
+		double sign = value ? 1.0 : -1.0;
+		int px = index % size, py = index / size;
+		for (int y = 0; y < size; y++)
+		{
+			const double *kernelRow = kernel.data() + ((y - py + size) % size) * size;
+			double *energyRow = energy.data() + y * size;
+			for (int x = 0; x < size; x++)
+				energyRow[x] += sign * kernelRow[(x - px + size) % size];
+		}
+	}
+
+	bool Get(int index) const { return pattern[index]; }
+
+	//Set pixel with the highest energy
+	int TightestCluster() const
+	{
+		int best = -1;
+		for (int i = 0; i < size * size; i++)
+		{
+			if (pattern[i] && (best < 0 || energy[i] > energy[best]))
+				best = i;
+		}
+		return best;
+	}
+
+	//Empty pixel with the lowest energy
+	int LargestVoid() const
+	{
+		int best = -1;
+		for (int i = 0; i < size * size; i++)
+		{
+			if (!pattern[i] && (best < 0 || energy[i] < energy[best]))
+				best = i;
+		}
+		return best;
+	}
+
+private:
+	int size;
+	std::vector<double> kernel;
+	std::vector<double> energy;
+	std::vector<bool> pattern;
+};
+
+//Ranks every pixel of a size x size mask, pixels with close ranks are spread evenly
+static std::vector<int> VoidAndCluster(int size)
+{
+	const int pixels = size * size;
+	const double sigma = 1.5;
+
+	//Initial pattern: a tenth of the pixels at fixed pseudo random places, so the mask is the same on every build
+	EnergyField field(size, sigma);
+	int ones = pixels / 10;
+	unsigned int state = 0x2545F491u;
+	for (int placed = 0; placed < ones;)
+	{
+		state = state * 1664525u + 1013904223u;
+		int index = (int)((state >> 8) % (unsigned int)pixels);
+		if (!field.Get(index))
+		{
+			field.Set(index, true);
+			placed++;
+		}
+	}
+
+	//Moves the pixel of the tightest cluster to the largest void until it lands where it started (with a limit in case it cycles)
+	for (int step = 0; step < pixels * 4; step++)
+	{
+		int cluster = field.TightestCluster();
+		field.Set(cluster, false);
+		int hole = field.LargestVoid();
+		field.Set(hole, true);
+		if (hole == cluster)
+			break;
+	}
+	std::vector<bool> prototype(pixels);
+	for (int i = 0; i < pixels; i++)
+		prototype[i] = field.Get(i);
+
+	std::vector<int> rank(pixels, -1);
+
+	//Phase 1: the prototype pixels get the lowest ranks, tightest clusters are removed first and get the highest of them
+	for (int r = ones - 1; r >= 0; r--)
+	{
+		int cluster = field.TightestCluster();
+		field.Set(cluster, false);
+		rank[cluster] = r;
+	}
+
+	//Phases 2 and 3: starting from the prototype again, the largest voids are filled one by one
+	EnergyField filled(size, sigma);
+	for (int i = 0; i < pixels; i++)
+	{
+		if (prototype[i])
+			filled.Set(i, true);
+	}
+	for (int r = ones; r < pixels; r++)
+	{
+		int hole = filled.LargestVoid();
+		filled.Set(hole, true);
+		rank[hole] = r;
+	}
+	return rank;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: dither_bluenoise <output header> [size]\n");
+		return 2;
+	}
+	int size = argc > 2 ? atoi(argv[2]) : 64;
+	if (size < 4 || (size & (size - 1)) != 0)
+	{
+		fprintf(stderr, "The size has to be a power of two of at least 4\n");
+		return 2;
+	}
+
+	std::vector<int> rank = VoidAndCluster(size);
+
+	FILE *out = fopen(argv[1], "w");
+	if (out == nullptr)
+	{
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	//Ranks are scaled to thresholds the same way as the Bayer matrices
+	fprintf(out, "#pragma once\n\n// Generated by dither_bluenoise (void-and-cluster), don't edit\n\n");
+	fprintf(out, "constexpr int blueNoiseSize = %d;\n\n", size);
+	fprintf(out, "static const unsigned char blueNoiseMask[%d] = {", size * size);
+	for (int i = 0; i < size * size; i++)
+		fprintf(out, "%s%d", i == 0 ? "\n\t" : i % size == 0 ? ",\n\t" : ", ", rank[i] * 256 / (size * size));
+	fprintf(out, "};\n");
+	fclose(out);
+	return 0;
+}